@@ -9,6 +9,10 @@ NEXTPNR_ECP5 := nextpnr-ecp5
 YOSYS := yosys
 ICEPACK := icepack
 ECPPACK := ecppack
+CCACHE := $(shell which ccache 2>/dev/null)
+
+# number of seeds tried by the nextpnr <project>-sweep targets
+SEEDS ?= 8
 
 VIVADOPATH := /work/xilinx/Vivado/2019.2
 XSDKPATH := /work/xilinx/SDK/2019.2
@@ -20,15 +24,22 @@ XMD := $(XSDKPATH)/bin/xmd
 
 ALL_BUILDS :=
 ALL_TARGETS :=
+ALL_NEXTPNR :=
 
 define project
 $(eval PROJECT_DEF := $1)\
 $(eval PROJECT_TYPE :=)\
 $(eval PROJECT_PART :=)\
 $(eval PROJECT_SRCS :=)\
+$(eval PROJECT_CSRCS :=)\
 $(eval PROJECT_VOPTS :=)\
 $(eval PROJECT_VERILOG_DEFS :=)\
 $(eval PROJECT_NEXTPNR_OPTS :=)\
+$(eval PROJECT_PGO_WORKLOAD :=)\
+$(eval PROJECT_PGO_ARGS :=)\
+$(eval PROJECT_PGO_DEPS :=)\
+$(eval PROJECT_SIM_OPTS :=)\
+$(eval PROJECT_SDRAM_MODEL :=)\
 $(eval include $(PROJECT_DEF))\
 $(eval PROJECT_NAME := $(patsubst project/%.def,%,$(PROJECT_DEF)))\
 $(eval pr-inc := $(wildcard $(patsubst %,build/%.mk,$(PROJECT_TYPE))))\
@@ -27,26 +27,34 @@ $(PROJECT_YS): $(PROJECT_SRCS) $(PROJECT_DEF) build/nextpnr-ecp5.mk
 	@echo synth_ecp5 -top top -json $(_JSON) >> $@
 
 $(PROJECT_LINT): _SRCS := $(PROJECT_VLG_SRCS)
-$(PROJECT_LINT): $(PROJECT_SRCS)
+$(PROJECT_LINT): _DEFS := $(PROJECT_VERILOG_DEFS)
+$(PROJECT_LINT): $(PROJECT_SRCS) $(PROJECT_DEF)
 	@mkdir -p $(dir $@)
 	@echo LINTING: $@
-	@$(VERILATOR) --top-module top --lint-only $(_SRCS)
+	@$(VERILATOR) --top-module top --lint-only $(addprefix -D,$(_DEFS)) $(_SRCS)
 	@touch $@
 
 $(PROJECT_JSON): _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).yosys.log
+$(PROJECT_JSON): _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).yosys.time
+$(PROJECT_JSON): _SRCS := $(PROJECT_VLG_SRCS)
 $(PROJECT_JSON): $(PROJECT_YS) $(PROJECT_LINT)
 	@mkdir -p $(dir $@)
 	@echo SYNTHESIZING: $@
-	@$(YOSYS) -s $< 2>&1 | tee $(_LOG)
+	@build/buildcache $(_LOG) -o $@ -k "`$(YOSYS) -V`" \
+		-f $< $(addprefix -v ,$(_SRCS)) -t $(_TIME) -- $(YOSYS) -s $<
 
 $(PROJECT_CONFIG): _OPTS := $(PROJECT_NEXTPNR_OPTS)
 $(PROJECT_CONFIG): _LPF := $(foreach lpf,$(PROJECT_LPF_SRCS),--lpf $(lpf))
 $(PROJECT_CONFIG): _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.log
+$(PROJECT_CONFIG): _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.time
 $(PROJECT_CONFIG): _JSON := $(PROJECT_JSON)
+$(PROJECT_CONFIG): _LPFS := $(PROJECT_LPF_SRCS)
 $(PROJECT_CONFIG): $(PROJECT_JSON) $(PROJECT_LPF_SRCS)
 	@mkdir -p $(dir $@)
 	@echo PLACING-AND-ROUTING: $@
-	$(NEXTPNR_ECP5) --json $(_JSON) --textcfg $@ $(_OPTS) $(_LPF) 2>&1 | tee $(_LOG)
+	build/buildcache $(_LOG) -o $@ -k "`$(NEXTPNR_ECP5) --version 2>&1`" \
+		-f $(_JSON) $(addprefix -f ,$(_LPFS)) -t $(_TIME) -- \
+		$(NEXTPNR_ECP5) --json $(_JSON) --textcfg $@ $(_OPTS) $(_LPF)
 
 $(PROJECT_BIT): _CONFIG := $(PROJECT_CONFIG)
 $(PROJECT_BIT): _BIT := $(PROJECT_BIT)
@@ -62,10 +70,30 @@ $(PROJECT_SVF): $(PROJECT_CONFIG)
 	@echo GENERATING: $@
 	@$(ECPPACK) --svf $(_SVF) $(_CONFIG) --compress
 
+# place-and-route with $(SEEDS) seeds in parallel, keeping the best result
+$(PROJECT_NAME)-sweep: _OPTS := $(PROJECT_NEXTPNR_OPTS)
+$(PROJECT_NAME)-sweep: _LPF := $(foreach lpf,$(PROJECT_LPF_SRCS),--lpf $(lpf))
+$(PROJECT_NAME)-sweep: _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.log
+$(PROJECT_NAME)-sweep: _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.time
+$(PROJECT_NAME)-sweep: _DIR := $(PROJECT_OBJDIR)/sweep
+$(PROJECT_NAME)-sweep: _JSON := $(PROJECT_JSON)
+$(PROJECT_NAME)-sweep: _CONFIG := $(PROJECT_CONFIG)
+$(PROJECT_NAME)-sweep: _BIT := $(PROJECT_BIT)
+$(PROJECT_NAME)-sweep: $(PROJECT_JSON) $(PROJECT_LPF_SRCS)
+	@mkdir -p $(dir $(_BIT))
+	@echo PLACING-AND-ROUTING: $(_CONFIG) '($(SEEDS) seeds)'
+	@start=`date +%s` ; build/nextpnr-sweep $(SEEDS) $(_DIR) $(_CONFIG) $(_LOG) --textcfg -- \
+		$(NEXTPNR_ECP5) --json $(_JSON) $(_OPTS) $(_LPF) && \
+		echo $$(( `date +%s` - $$start )) > $(_TIME)
+	@echo GENERATING: $(_BIT)
+	@$(ECPPACK) $(_CONFIG) $(_BIT) --compress
+
 $(PROJECT_NAME): $(PROJECT_BIT)
 
-ALL_TARGETS += $(PROJECT_NAME)
+ALL_TARGETS += $(PROJECT_NAME) $(PROJECT_NAME)-sweep
 ALL_BUILDS += $(PROJECT_NAME)
+ALL_NEXTPNR += $(PROJECT_NAME)
 
 TARGET_$(PROJECT_NAME)_DESC := build ecp5 bitfile: $(PROJECT_BIT)
+TARGET_$(PROJECT_NAME)-sweep_DESC := build ecp5 bitfile, best of $(SEEDS) P&R seeds
 
@@ -31,28 +31,55 @@ $(PROJECT_LINT): $(PROJECT_SRCS)
 	@touch $@
 
 $(PROJECT_JSON): _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).yosys.log
+$(PROJECT_JSON): _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).yosys.time
+$(PROJECT_JSON): _SRCS := $(PROJECT_VLG_SRCS)
 $(PROJECT_JSON): $(PROJECT_YS) $(PROJECT_LINT)
 	@mkdir -p $(dir $@)
 	@echo SYNTHESIZING: $@
-	@$(YOSYS) -s $< 2>&1 | tee $(_LOG)
+	@build/buildcache $(_LOG) -o $@ -k "`$(YOSYS) -V`" \
+		-f $< $(addprefix -v ,$(_SRCS)) -t $(_TIME) -- $(YOSYS) -s $<
 
 $(PROJECT_ASC): _OPTS := $(PROJECT_NEXTPNR_OPTS)
 $(PROJECT_ASC): _PCF := $(foreach pcf,$(PROJECT_PCF_SRCS),--pcf $(pcf))
 $(PROJECT_ASC): _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.log
+$(PROJECT_ASC): _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.time
+$(PROJECT_ASC): _PCFS := $(PROJECT_PCF_SRCS)
 $(PROJECT_ASC): $(PROJECT_JSON) $(PROJECT_PCF_SRCS)
 	@mkdir -p $(dir $@)
 	@echo PLACING-AND-ROUTING: $@
-	@$(NEXTPNR_ICE40) --asc $@ --json $< $(_PCF) $(_OPTS) 2>&1 | tee $(_LOG)
+	@build/buildcache $(_LOG) -o $@ -k "`$(NEXTPNR_ICE40) --version 2>&1`" \
+		-f $< $(addprefix -f ,$(_PCFS)) -t $(_TIME) -- \
+		$(NEXTPNR_ICE40) --asc $@ --json $< $(_PCF) $(_OPTS)
 
 $(PROJECT_BIN): $(PROJECT_ASC)
 	@mkdir -p $(dir $@)
 	@echo PACKING: $@
 	@$(ICEPACK) $< $@
 
+# place-and-route with $(SEEDS) seeds in parallel, keeping the best result
+$(PROJECT_NAME)-sweep: _OPTS := $(PROJECT_NEXTPNR_OPTS)
+$(PROJECT_NAME)-sweep: _PCF := $(foreach pcf,$(PROJECT_PCF_SRCS),--pcf $(pcf))
+$(PROJECT_NAME)-sweep: _LOG := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.log
+$(PROJECT_NAME)-sweep: _TIME := $(PROJECT_OBJDIR)/$(PROJECT_NAME).nextpnr.time
+$(PROJECT_NAME)-sweep: _DIR := $(PROJECT_OBJDIR)/sweep
+$(PROJECT_NAME)-sweep: _JSON := $(PROJECT_JSON)
+$(PROJECT_NAME)-sweep: _ASC := $(PROJECT_ASC)
+$(PROJECT_NAME)-sweep: _BIN := $(PROJECT_BIN)
+$(PROJECT_NAME)-sweep: $(PROJECT_JSON) $(PROJECT_PCF_SRCS)
+	@mkdir -p $(dir $(_BIN))
+	@echo PLACING-AND-ROUTING: $(_ASC) '($(SEEDS) seeds)'
+	@start=`date +%s` ; build/nextpnr-sweep $(SEEDS) $(_DIR) $(_ASC) $(_LOG) --asc -- \
+		$(NEXTPNR_ICE40) --json $(_JSON) $(_PCF) $(_OPTS) && \
+		echo $$(( `date +%s` - $$start )) > $(_TIME)
+	@echo PACKING: $(_BIN)
+	@$(ICEPACK) $(_ASC) $(_BIN)
+
 $(PROJECT_NAME): $(PROJECT_BIN)
 
-ALL_TARGETS += $(PROJECT_NAME)
+ALL_TARGETS += $(PROJECT_NAME) $(PROJECT_NAME)-sweep
 ALL_BUILDS += $(PROJECT_NAME)
+ALL_NEXTPNR += $(PROJECT_NAME)
 
 TARGET_$(PROJECT_NAME)_DESC := build ice40 bitfile: $(PROJECT_BIN)
+TARGET_$(PROJECT_NAME)-sweep_DESC := build ice40 bitfile, best of $(SEEDS) P&R seeds
 
@@ -3,6 +3,62 @@
 ## Licensed under the Apache License, Version 2.0 
 ## http://www.apache.org/licenses/LICENSE-2.0
 
+ifeq ($(VSIM_RUNTIME_OPTS),)
+# The Verilator runtime and the sim support code that does not depend
+# on the generated model (sim-sdram) are compiled once into an archive
+# that verilator-sim projects link against, instead of into each
+# project's object directory.
+#
+# The runtime must be built with the same VM_* settings and flags as
+# the models using it, so there is one archive per combination of the
+# Verilator options that change them, and each is compiled by the
+# makefile Verilator generates for an empty model with those options
+# (so verilated.mk provides the flags).
+
+# options that change how the runtime is compiled
+VSIM_RUNTIME_OPTS := --trace% --threads --timing --no-timing --coverage% --sc --savable
+
+vsim-space := $(subst ,, )
+
+# out/-vsim-/-common-<options>/libvsim.a for verilator options $(1)
+vsim-common-dir = out/-vsim-/-common$(if $(strip $(1)),$(subst $(vsim-space),,$(patsubst --%,-%,$(sort $(1)))),-none)
+vsim-common-lib = $(call vsim-common-dir,$(1))/libvsim.a
+
+define vsim-common-rules
+VSIM_COMMON_DONE += $(call vsim-common-dir,$(1))
+
+$(call vsim-common-lib,$(1)): _DIR := $(call vsim-common-dir,$(1))
+$(call vsim-common-lib,$(1)): _OPTS := $(1)
+
+$(call vsim-common-lib,$(1)): src/sim-sdram.cpp src/sim-sdram.h build/verilator-sim.mk
+	@rm -rf $$(_DIR)
+	@mkdir -p $$(_DIR)
+	@echo "COMPILE (verilator runtime): $$(_DIR)"
+	@echo "module vsim_common(input wire clk); endmodule" > $$(_DIR)/vsim_common.sv
+	@$$(VERILATOR) --cc $$(_OPTS) --top-module vsim_common --Mdir $$(_DIR) \
+		--exe ../../src/sim-sdram.cpp -CFLAGS -DSDRAM $$(_DIR)/vsim_common.sv
+	@$$(MAKE) --no-print-directory -C $$(_DIR) -f Vvsim_common.mk OBJCACHE=$$(CCACHE) \
+		--eval='vsim-common-objs: $$$$(VK_GLOBAL_OBJS) verilated_dpi.o sim-sdram.o' vsim-common-objs
+	@echo "ARCHIVE: $$@"
+	@$$(AR) rcs $$@ $$(_DIR)/*.o
+endef
+
+# define the archive's rules, once per set of options
+vsim-common = $(if $(filter $(call vsim-common-dir,$(1)),$(VSIM_COMMON_DONE)),,$(eval $(call vsim-common-rules,$(1))))
+endif
+
+# PROJECT_SDRAM_MODEL := tlm replaces the sdram controller and
+# pin-level SDRAM model with a transaction-level memory
+ifeq ($(PROJECT_SDRAM_MODEL),tlm)
+PROJECT_SRCS := $(patsubst hdl/sdram/sdram.sv,hdl/sdram/sdram_tlm.sv,$(PROJECT_SRCS))
+PROJECT_VOPTS += -CFLAGS -DSDRAM_TLM
+endif
+
+# models are always built with --trace
+PROJECT_VSIM_CFG := $(filter $(VSIM_RUNTIME_OPTS),--trace $(PROJECT_VOPTS))
+PROJECT_VSIM_LIB := $(call vsim-common-lib,$(PROJECT_VSIM_CFG))
+$(call vsim-common,$(PROJECT_VSIM_CFG))
+
 PROJECT_OBJDIR := out/-vsim-/$(PROJECT_NAME)
 PROJECT_RUN := $(PROJECT_NAME)-vsim
 PROJECT_BIN := out/$(PROJECT_NAME)-vsim
@@ -11,10 +67,11 @@ PROJECT_VLG_SRCS := $(filter %.v %.sv,$(PROJECT_SRCS))
 
 PROJECT_OPTS := --top-module testbench
 PROJECT_OPTS += --Mdir $(PROJECT_OBJDIR)
-PROJECT_OPTS += --exe ../../src/testbench.cpp ../../src/sim-sdram.cpp
+PROJECT_OPTS += --exe ../../src/testbench.cpp $(addprefix ../../,$(PROJECT_CSRCS))
 PROJECT_OPTS += --cc
 PROJECT_OPTS += -o ../../$(PROJECT_NAME)-vsim
-PROJECT_OPTS += -DSIMULATION
+PROJECT_OPTS += -LDFLAGS $(abspath $(PROJECT_VSIM_LIB))
+PROJECT_OPTS += -DSIMULATION -DSDRAM_SPLIT_DATA
 PROJECT_OPTS += $(PROJECT_VOPTS)
 
 PROJECT_OPTS += -CFLAGS -DTRACE --trace
@@ -24,24 +81,107 @@ $(PROJECT_BIN): _SRCS := $(PROJECT_VLG_SRCS)
 $(PROJECT_BIN): _OPTS := $(PROJECT_OPTS)
 $(PROJECT_BIN): _DIR := $(PROJECT_OBJDIR)
 
-$(PROJECT_BIN): $(PROJECT_SRCS) $(PROJECT_DEF) src/testbench.cpp src/sim-sdram.cpp
+# the runtime objects Vtestbench.mk would build (VM_GLOBAL_*) come
+# from the shared archive for its options instead, and the model build runs under
+# this make's jobserver (and ccache, if available)
+$(PROJECT_BIN): $(PROJECT_SRCS) $(PROJECT_CSRCS) $(PROJECT_DEF) src/testbench.cpp $(PROJECT_VSIM_LIB)
 	@mkdir -p $(_DIR) bin
 	@echo "COMPILE (verilator): $(_NAME)"
 	@$(VERILATOR) $(_OPTS) $(_SRCS)
 	@echo "COMPILE (C++): $(_NAME)"
-	make -C $(_DIR) -f Vtestbench.mk
+	@$(MAKE) --no-print-directory -C $(_DIR) -f Vtestbench.mk \
+		VM_GLOBAL_FAST= VM_GLOBAL_SLOW= OBJCACHE=$(CCACHE)
 
 $(PROJECT_NAME): $(PROJECT_BIN)
 
+# Profile-Guided Optimized build
+# - verilate once, then compile those sources with -fprofile-generate
+# - run the project's workload to collect *.gcda
+# - rebuild the same sources in the same object directory with
+#   -fprofile-use, -O3, and LTO, so the profile matches the code
+# - multithreaded models (--threads in PROJECT_VOPTS) first get a
+#   Verilator --prof-pgo run, whose profile.vlt is used to verilate
+#   (it only has scheduling data for threaded models)
+# - tracing is omitted from this build, as it is for long runs
+
+PROJECT_PGO_DIR := out/-vsim-pgo-/$(PROJECT_NAME)
+PROJECT_PGO_BIN := out/$(PROJECT_NAME)-vsim-pgo
+
+# the -CFLAGS/-LDFLAGS '$(PGO_FLAGS)' is expanded when Vtestbench.mk
+# runs, so the two compiles differ only in the PGO_FLAGS given to make
+PGO_GEN_FLAGS := -fprofile-generate
+PGO_USE_FLAGS := -fprofile-use -fprofile-correction -Wno-missing-profile -flto
+
+PROJECT_PGO_OPTS := --top-module testbench
+PROJECT_PGO_OPTS += --exe ../../src/testbench.cpp ../../src/sim-sdram.cpp
+PROJECT_PGO_OPTS += $(addprefix ../../,$(PROJECT_CSRCS))
+PROJECT_PGO_OPTS += --cc
+PROJECT_PGO_OPTS += -DSIMULATION -DSDRAM_SPLIT_DATA
+PROJECT_PGO_OPTS += $(PROJECT_VOPTS)
+PROJECT_PGO_OPTS += -CFLAGS -O3 -CFLAGS -march=native -CFLAGS '$$(PGO_FLAGS)'
+PROJECT_PGO_OPTS += -LDFLAGS -O3 -LDFLAGS -march=native -LDFLAGS '$$(PGO_FLAGS)'
+
+# run the workload on the sim given as $(1), with extra sim args $(2)
+PROJECT_PGO_RUN = $(if $(_WORKLOAD),$(_WORKLOAD) $(1) $(2),$(1) $(_ARGS) $(2))
+
+ifneq ($(filter --threads,$(PROJECT_VOPTS)),)
+PROJECT_PGO_VLT := $(PROJECT_PGO_DIR)-vlt/profile.vlt
+
+$(PROJECT_PGO_VLT): _NAME := $(PROJECT_NAME)
+$(PROJECT_PGO_VLT): _SRCS := $(PROJECT_VLG_SRCS)
+$(PROJECT_PGO_VLT): _OPTS := $(PROJECT_PGO_OPTS)
+$(PROJECT_PGO_VLT): _DIR := $(PROJECT_PGO_DIR)-vlt
+$(PROJECT_PGO_VLT): _WORKLOAD := $(PROJECT_PGO_WORKLOAD)
+$(PROJECT_PGO_VLT): _ARGS := $(PROJECT_PGO_ARGS)
+
+$(PROJECT_PGO_VLT): $(PROJECT_SRCS) $(PROJECT_CSRCS) $(PROJECT_DEF) $(PROJECT_PGO_WORKLOAD) $(PROJECT_PGO_DEPS) src/testbench.cpp src/sim-sdram.cpp
+	@rm -rf $(_DIR)
+	@mkdir -p $(_DIR)
+	@echo "COMPILE (verilator, prof-pgo): $(_NAME)"
+	@$(VERILATOR) $(_OPTS) --Mdir $(_DIR) --prof-pgo -o $(_NAME)-vsim-prof $(_SRCS)
+	@echo "COMPILE (C++, prof-pgo): $(_NAME)"
+	$(MAKE) -C $(_DIR) -f Vtestbench.mk
+	@echo "PROFILE (verilator): $(_NAME)"
+	@$(call PROJECT_PGO_RUN,$(_DIR)/$(_NAME)-vsim-prof,+verilator+prof+vlt+file+$@) > $(_DIR)/profile.log
+else
+PROJECT_PGO_VLT :=
+endif
+
+$(PROJECT_PGO_BIN): _NAME := $(PROJECT_NAME)
+$(PROJECT_PGO_BIN): _SRCS := $(PROJECT_VLG_SRCS)
+$(PROJECT_PGO_BIN): _OPTS := $(PROJECT_PGO_OPTS)
+$(PROJECT_PGO_BIN): _DIR := $(PROJECT_PGO_DIR)
+$(PROJECT_PGO_BIN): _VLT := $(PROJECT_PGO_VLT)
+$(PROJECT_PGO_BIN): _WORKLOAD := $(PROJECT_PGO_WORKLOAD)
+$(PROJECT_PGO_BIN): _ARGS := $(PROJECT_PGO_ARGS)
+
+$(PROJECT_PGO_BIN): $(PROJECT_SRCS) $(PROJECT_CSRCS) $(PROJECT_DEF) $(PROJECT_PGO_WORKLOAD) $(PROJECT_PGO_DEPS) src/testbench.cpp src/sim-sdram.cpp $(PROJECT_PGO_VLT)
+	@rm -rf $(_DIR)
+	@mkdir -p $(_DIR)
+	@echo "COMPILE (verilator, pgo): $(_NAME)"
+	@$(VERILATOR) $(_OPTS) --Mdir $(_DIR) -o $(_NAME)-vsim-pgo $(_VLT) $(_SRCS)
+	@echo "COMPILE (C++, pgo-gen): $(_NAME)"
+	$(MAKE) -C $(_DIR) -f Vtestbench.mk PGO_FLAGS="$(PGO_GEN_FLAGS)"
+	@echo "PROFILE: $(_NAME)"
+	@$(call PROJECT_PGO_RUN,$(_DIR)/$(_NAME)-vsim-pgo) > $(_DIR)/profile.log
+	@rm -f $(_DIR)/*.o $(_DIR)/*.a $(_DIR)/$(_NAME)-vsim-pgo
+	@echo "COMPILE (C++, pgo-use): $(_NAME)"
+	$(MAKE) -C $(_DIR) -f Vtestbench.mk PGO_FLAGS="$(PGO_USE_FLAGS)"
+	@cp $(_DIR)/$(_NAME)-vsim-pgo $@
+
+$(PROJECT_NAME)-pgo: $(PROJECT_PGO_BIN)
+
 $(PROJECT_RUN): _LOGFILE := out/sim/$(PROJECT_NAME).log
 $(PROJECT_RUN): _VCDFILE := out/sim/$(PROJECT_NAME).vcd
+$(PROJECT_RUN): _SIMOPTS := $(PROJECT_SIM_OPTS)
 $(PROJECT_RUN): $(PROJECT_BIN)
 	@mkdir -p out/sim
-	@$< -trace $(_VCDFILE) > $(_LOGFILE)
+	@$< -trace $(_VCDFILE) $(_SIMOPTS) > $(_LOGFILE)
 
-ALL_TARGETS += $(PROJECT_NAME) $(PROJECT_RUN) 
+ALL_TARGETS += $(PROJECT_NAME) $(PROJECT_RUN) $(PROJECT_NAME)-pgo
 ALL_BUILDS += $(PROJECT_NAME)
 
 TARGET_$(PROJECT_NAME)_DESC := build verilator sim: $(PROJECT_BIN)
 TARGET_$(PROJECT_RUN)_DESC := run verilator sim: $(PROJECT_BIN)
+TARGET_$(PROJECT_NAME)-pgo_DESC := build profile-optimized verilator sim: $(PROJECT_PGO_BIN)
 
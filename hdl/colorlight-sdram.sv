@@ -93,6 +93,32 @@ testbench #(
 	.info_e(info_e)
 );
 
+// performance counters, shown on the bottom row (8 hex digits
+// each, PERF_* order), refreshed and cleared every 2^24 clocks
+reg [23:0]perf_timer = 0;
+reg perf_dump = 0;
+reg [5:0]perf_idx = 0;
+reg perf_clear = 0;
+wire [31:0]perf_data;
+wire [31:0]perf_shift = perf_data << { perf_idx[1:0], 3'd0 };
+wire perf_we = perf_dump & (~info_e);
+
+always_ff @(posedge testclk) begin
+	perf_clear <= 0;
+	perf_timer <= perf_timer + 24'd1;
+	if (perf_timer == 24'd0)
+		perf_dump <= 1;
+	if (perf_we) begin
+		if (perf_idx == 6'd39) begin
+			perf_idx <= 6'd0;
+			perf_dump <= 0;
+			perf_clear <= 1;
+		end else begin
+			perf_idx <= perf_idx + 6'd1;
+		end
+	end
+end
+
 sdram #(
 	.BANKBITS(1),
 	.ROWBITS(11),
@@ -101,7 +127,8 @@ sdram #(
 	.T_RI(1900),
 	.T_RCD(3), 
 	.CLK_SHIFT(1),
-	.CLK_DELAY(0)
+	.CLK_DELAY(0),
+	.PERF_COUNTERS(1)
 	) sdram0 (
 	.clk(testclk),
 	.reset(0),
@@ -130,7 +157,11 @@ sdram #(
 	.wr_data(wr_data),
 	.wr_len(wr_len),
 	.wr_req(wr_req),
-	.wr_ack(wr_ack)
+	.wr_ack(wr_ack),
+
+	.perf_addr(perf_idx[5:2]),
+	.perf_data(perf_data),
+	.perf_clear(perf_clear)
 );
 
 
@@ -140,7 +171,7 @@ assign j1g1 = j1g0;
 
 reg [10:0]waddr = 11'd0;
 
-wire [10:0]waddr_next = (waddr == 11'd1199) ? 11'd0 : (waddr + 11'd1);
+wire [10:0]waddr_next = (waddr == 11'd1159) ? 11'd0 : (waddr + 11'd1);
 
 always_ff @(posedge testclk) begin
 	waddr <= (info_e) ? waddr_next : waddr;
@@ -161,9 +192,9 @@ display #(
         .active(),
         .frame(),
         .wclk(testclk),
-        .waddr({waddr,1'b0}),
-        .wdata(info),
-        .we(info_e)
+        .waddr(perf_we ? { 11'd1160 + { 5'd0, perf_idx }, 1'b0 } : { waddr, 1'b0 }),
+        .wdata(perf_we ? { 8'h70, perf_shift[31:24] } : info),
+        .we(info_e | perf_we)
 );
 
 endmodule
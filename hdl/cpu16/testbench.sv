@@ -5,8 +5,14 @@
 
 `timescale 1ns / 1ps
 
+import "DPI-C" function void dpi_trace_retire(input int cycle, input int pc,
+	input int ins, input int flags, input int wreg, input int rdata,
+	input int maddr, input int mdata);
+
 module testbench(
-	input clk
+	input clk,
+	output reg error = 0,
+	output reg done = 0
 	);
 
 reg [15:0]count = 16'd0;
@@ -14,17 +20,76 @@ reg reset = 1'b0;
 
 reg burp = 1'b0;
 
+// performance counters, reported at halt for tests/runtest
+// - an instruction issues when it leaves decode for execute
+// - a stall is a cycle where a valid instruction is held in
+//   decode by a register hazard
+reg [31:0]perf_cycles = 32'd0;
+reg [31:0]perf_issued = 32'd0;
+reg [31:0]perf_stalls = 32'd0;
+
+wire perf_issue = cpu.de_ir_valid & (~cpu.de_pause) & (~cpu.ex_do_branch);
+wire perf_stall = cpu.de_ir_valid & cpu.de_pause;
+
+// fail after +cycles=n (default 1000) cycles without a halt
+reg [31:0]max_cycles = 32'd1000;
+
+initial begin
+	if (!$value$plusargs("cycles=%d", max_cycles))
+		max_cycles = 32'd1000;
+end
+
 always @(posedge clk) begin
 	count <= count + 16'd1;
+	perf_cycles <= perf_cycles + 32'd1;
+	if (perf_issue) perf_issued <= perf_issued + 32'd1;
+	if (perf_stall) perf_stalls <= perf_stalls + 32'd1;
 //	burp <= (count >= 16'd0010) && (count <= 16'd0012) ? 1'b1 : 1'b0;
 	if (count == 16'd0005) reset <= 1'b0;
-	if (count == 16'd1000) $finish;
+	if (perf_cycles == max_cycles) error <= 1'b1;
 	if (cpu.de_ir == 16'hFFFF) begin
 		for ( integer i = 0; i < 8; i++ ) begin
 			$display(":REG R%0d %8X", i, cpu.regs.rmem[i]);
 		end
+		$display(":CYC %0d %0d %0d", perf_cycles, perf_issued, perf_stalls);
 		$display(":END");
-		$finish;
+		done <= 1'b1;
+	end
+end
+
+// retirement trace (testbench -itrace): follow each issued instruction
+// through ex to wb and report it there, with its register write (or
+// load data) and memory access
+reg tr_ex_valid = 1'b0;
+reg [15:0]tr_ex_pc = 16'd0;
+reg [15:0]tr_ex_ins = 16'd0;
+
+reg tr_wb_valid = 1'b0;
+reg [15:0]tr_wb_pc = 16'd0;
+reg [15:0]tr_wb_ins = 16'd0;
+reg tr_wb_rd = 1'b0;
+reg tr_wb_wr = 1'b0;
+reg [15:0]tr_wb_maddr = 16'd0;
+reg [15:0]tr_wb_mdata = 16'd0;
+
+wire tr_wb_wreg = cpu.wb_regs_do_wr_reg | cpu.wb_regs_do_wr_dat;
+
+always @(posedge clk) begin
+	tr_ex_valid <= perf_issue;
+	tr_ex_pc <= cpu.de_pc_plus_1 - 16'd1;
+	tr_ex_ins <= cpu.de_ir;
+	tr_wb_valid <= tr_ex_valid;
+	tr_wb_pc <= tr_ex_pc;
+	tr_wb_ins <= tr_ex_ins;
+	tr_wb_rd <= cpu.dat_rd_req;
+	tr_wb_wr <= cpu.dat_wr_req;
+	tr_wb_maddr <= cpu.dat_rw_addr;
+	tr_wb_mdata <= cpu.dat_wr_data;
+	if (tr_wb_valid) begin
+		dpi_trace_retire(perf_cycles, { 16'd0, tr_wb_pc }, { 16'd0, tr_wb_ins },
+			{ 29'd0, tr_wb_wr, tr_wb_rd, tr_wb_wreg },
+			{ 29'd0, cpu.wb_regs_wsel }, { 16'd0, cpu.regs_wdata },
+			{ 16'd0, tr_wb_maddr }, { 16'd0, tr_wb_rd ? cpu.dat_rd_data : tr_wb_mdata });
 	end
 end
 
@@ -0,0 +1,263 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// SDRAM controller benchmark
+//
+// Drives sdram.sv's request ports with one traffic pattern and
+// reports throughput and read latency via DPI (src/sim-bench.cpp).
+//
+// +pattern=N  0 seq-read    sequential reads of len+1 words
+//             1 seq-write   sequential writes of len+1 words
+//             2 rand-read   single word reads, random addresses
+//             3 rand-write  single word writes, random addresses
+//             4 interleave  sequential reads rotating across banks
+//             5 mix         sequential, randomly read or write
+//             6 scanout     sequential reads with a random single
+//                           word write every 8th request
+// +len=N      rd_len/wr_len (0-15) for the sequential patterns
+// +count=N    number of requests (default 10000)
+
+module testbench #(
+	parameter BANKBITS = 1,
+	parameter ROWBITS = 11,
+	parameter COLBITS = 8,
+	parameter T_RI = 1900,
+	parameter T_RC = 8,
+	parameter T_RCD = 3,
+	parameter T_RRD = 3,
+	parameter T_RP = 3,
+	parameter T_WR = 2,
+	parameter T_MRD = 3
+	) (
+	input wire clk,
+	output reg done = 0,
+	output reg error = 0,
+
+	output wire sdram_ras_n,
+	output wire sdram_cas_n,
+	output wire sdram_we_n,
+	output wire [AWIDTH-1:0]sdram_addr,
+	output wire [15:0]sdram_data_o,
+	input wire [15:0]sdram_data_i
+	);
+
+import "DPI-C" function void dpi_bench_latency(input int cycles);
+import "DPI-C" function void dpi_bench_done(input int pattern, input int len,
+	input int cycles, input int rd_words, input int wr_words);
+
+localparam AWIDTH = (ROWBITS + BANKBITS);
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+localparam AMSB = XWIDTH-1;
+
+localparam P_SEQ_READ = 0;
+localparam P_SEQ_WRITE = 1;
+localparam P_RAND_READ = 2;
+localparam P_RAND_WRITE = 3;
+localparam P_INTERLEAVE = 4;
+localparam P_MIX = 5;
+localparam P_SCANOUT = 6;
+
+integer pattern = P_SEQ_READ;
+integer len = 0;
+integer count = 10000;
+
+initial begin
+	if (!$value$plusargs("pattern=%d", pattern)) pattern = P_SEQ_READ;
+	if (!$value$plusargs("len=%d", len)) len = 0;
+	if (!$value$plusargs("count=%d", count)) count = 10000;
+	if ((pattern == P_RAND_READ) || (pattern == P_RAND_WRITE)) len = 0;
+end
+
+wire [3:0]rlen = len[3:0];
+wire [4:0]words = { 1'b0, rlen } + 5'd1;
+
+reg [AMSB:0]rd_addr = 0;
+reg [3:0]rd_len = 0;
+reg rd_req = 0;
+wire rd_ack;
+wire [15:0]rd_data;
+wire rd_rdy;
+
+reg [AMSB:0]wr_addr = 0;
+reg [15:0]wr_data = 0;
+reg [3:0]wr_len = 0;
+reg wr_req = 0;
+wire wr_ack;
+
+sdram #(
+	.BANKBITS(BANKBITS),
+	.ROWBITS(ROWBITS),
+	.COLBITS(COLBITS),
+	.T_RI(T_RI),
+	.T_RC(T_RC),
+	.T_RCD(T_RCD),
+	.T_RRD(T_RRD),
+	.T_RP(T_RP),
+	.T_WR(T_WR),
+	.T_MRD(T_MRD),
+	.T_PWR_UP(100)
+	) sdram0 (
+	.clk(clk),
+	.reset(1'b0),
+	.pin_clk(),
+	.pin_ras_n(sdram_ras_n),
+	.pin_cas_n(sdram_cas_n),
+	.pin_we_n(sdram_we_n),
+	.pin_data_i(sdram_data_i),
+	.pin_data_o(sdram_data_o),
+	.pin_addr(sdram_addr),
+	.rd_addr(rd_addr),
+	.rd_len(rd_len),
+	.rd_req(rd_req),
+	.rd_ack(rd_ack),
+	.rd_data(rd_data),
+	.rd_rdy(rd_rdy),
+	.wr_addr(wr_addr),
+	.wr_data(wr_data),
+	.wr_len(wr_len),
+	.wr_req(wr_req),
+	.wr_ack(wr_ack)
+);
+
+wire [31:0]rnd;
+reg rnd_next = 0;
+
+xorshift32 rng (
+	.clk(clk),
+	.next(rnd_next),
+	.reset(1'b0),
+	.data(rnd)
+);
+
+localparam WARMUP = 2'd0;
+localparam RUN = 2'd1;
+localparam DRAIN = 2'd2;
+localparam HALT = 2'd3;
+
+reg [1:0]state = WARMUP;
+
+reg [31:0]now = 0;
+reg [31:0]start = 0;
+reg [31:0]issued = 0;
+reg [31:0]seqn = 0;
+reg [31:0]t_req = 0;
+reg [31:0]rd_words = 0;
+reg [31:0]wr_words = 0;
+
+// read requests acked and awaiting data: request time, in order
+reg [31:0]rq_time[0:15];
+reg [3:0]rq_wr = 0;
+reg [3:0]rq_rd = 0;
+reg [4:0]rd_left = 0;
+wire rq_empty = (rq_wr == rq_rd);
+wire idle = (!rd_req) && (!wr_req) && rq_empty && (rd_left == 5'd0);
+
+// address of the n'th sequential or bank-interleaved request
+wire [31:0]seq_addr = seqn * { 27'd0, words };
+wire [31:0]ilv_rowcol = (seqn >> BANKBITS) * { 27'd0, words };
+wire [AMSB:0]ilv_addr = { ilv_rowcol[ROWBITS+COLBITS-1:COLBITS],
+	seqn[BANKBITS-1:0], ilv_rowcol[COLBITS-1:0] };
+
+// the next request: read (1) or write (0), address, length
+reg next_rd;
+reg [AMSB:0]next_addr;
+reg [3:0]next_len;
+
+always_comb begin
+	next_rd = 1;
+	next_addr = seq_addr[AMSB:0];
+	next_len = rlen;
+	case (pattern)
+	P_SEQ_WRITE: next_rd = 0;
+	P_RAND_READ: next_addr = rnd[AMSB:0];
+	P_RAND_WRITE: begin
+		next_rd = 0;
+		next_addr = rnd[AMSB:0];
+	end
+	P_INTERLEAVE: next_addr = ilv_addr;
+	P_MIX: next_rd = rnd[31];
+	P_SCANOUT: if (seqn[2:0] == 3'd7) begin
+		next_rd = 0;
+		next_addr = rnd[AMSB:0];
+		next_len = 0;
+	end
+	default: ;
+	endcase
+end
+
+// a request is held until acked, and the next one is presented
+// in the cycle the ack is seen, so the controller never waits
+wire can_issue = ((!rd_req) && (!wr_req)) || (rd_req & rd_ack) || (wr_req & wr_ack);
+
+always_ff @(posedge clk) begin
+	now <= now + 32'd1;
+	rnd_next <= 0;
+
+	// read data returns in request order
+	if (rd_rdy) begin
+		if (rd_left == 5'd0) begin
+			if (rq_empty) begin
+				error <= 1;
+			end else begin
+				if (state == RUN || state == DRAIN)
+					dpi_bench_latency(now - rq_time[rq_rd]);
+				rq_rd <= rq_rd + 4'd1;
+				rd_left <= words - 5'd1;
+			end
+		end else begin
+			rd_left <= rd_left - 5'd1;
+		end
+		rd_words <= rd_words + 32'd1;
+	end
+
+	if (rd_req & rd_ack) begin
+		rd_req <= 0;
+		rq_time[rq_wr] <= t_req;
+		rq_wr <= rq_wr + 4'd1;
+	end
+	if (wr_req & wr_ack) begin
+		wr_req <= 0;
+		wr_words <= wr_words + { 28'd0, wr_len } + 32'd1;
+	end
+
+	case (state)
+	WARMUP: if (now == 32'd1) begin
+		// one read to wait out controller init
+		rd_req <= 1;
+		rd_addr <= 0;
+		rd_len <= rlen;
+	end else if ((now > 32'd1) && idle) begin
+		state <= RUN;
+		start <= now;
+		rd_words <= 0;
+	end
+	RUN: if (issued == count) begin
+		state <= DRAIN;
+	end else if (can_issue) begin
+		issued <= issued + 32'd1;
+		rnd_next <= 1;
+		seqn <= seqn + 32'd1;
+		t_req <= now;
+		if (next_rd) begin
+			rd_req <= 1;
+			rd_addr <= next_addr;
+			rd_len <= next_len;
+		end else begin
+			wr_req <= 1;
+			wr_addr <= next_addr;
+			wr_len <= next_len;
+			wr_data <= rnd[15:0];
+		end
+	end
+	DRAIN: if (idle) begin
+		dpi_bench_done(pattern, len, now - start, rd_words, wr_words);
+		state <= HALT;
+		done <= 1;
+	end
+	HALT: ;
+	endcase
+end
+
+endmodule
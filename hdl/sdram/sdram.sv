@@ -19,6 +19,14 @@
 //
 // tWR (Write Recovery Time)
 // Min clocks between the last word of a write and PRECHARGE of that bank
+//
+// Rows are left open after each access (open page policy), so an
+// access to the open row of its bank issues READ/WRITE right away,
+// an access to an idle bank only needs ACTIVE, and only an access
+// to a different row of an active bank needs PRECHARGE first.
+// PRECHARGE/ACTIVE for a write overlap any read data still in
+// flight.  With burst length 1 the command bus is busy for the whole
+// of a burst, so row setup for the next request starts after it.
 
 module sdram #(
 	// Memory Geometry
@@ -39,7 +47,10 @@ module sdram #(
 
 	// Fine TuningA
 	parameter CLK_SHIFT = 0,   // 1 = delay clock by 1/2 cycle (if 1)
-	parameter CLK_DELAY = 0    // 1..128 = delay clock by N x 25pS (ECP5)
+	parameter CLK_DELAY = 0,   // 1..128 = delay clock by N x 25pS (ECP5)
+
+	// Debug
+	parameter PERF_COUNTERS = 0 // 1 = include performance counters
 	) (
 	input wire clk,
 	input wire reset,
@@ -47,7 +58,13 @@ module sdram #(
 	output wire pin_ras_n,
 	output wire pin_cas_n,
 	output wire pin_we_n,
+`ifdef SDRAM_SPLIT_DATA
+	// no tristate bus in the sims and synth wrapper, which set this
+	input wire [DWIDTH-1:0]pin_data_i,
+	output wire [DWIDTH-1:0]pin_data_o,
+`else
 	inout wire [DWIDTH-1:0]pin_data,
+`endif
 	output wire [AWIDTH-1:0]pin_addr,
 
 	input wire [XWIDTH-1:0]rd_addr,
@@ -62,7 +79,15 @@ module sdram #(
 	input wire [DWIDTH-1:0]wr_data,
 	input wire [3:0]wr_len,
 	input wire wr_req,
-	output reg wr_ack = 0
+	output reg wr_ack = 0,
+
+	// wr_data is taken at the end of this cycle, present the next word
+	output reg wr_next,
+
+	// performance counters (if PERF_COUNTERS), see PERF_* below
+	input wire [3:0]perf_addr,
+	output reg [31:0]perf_data,
+	input wire perf_clear
 	);
 
 // sdram addr is wide enough for row + bank
@@ -137,6 +162,30 @@ reg bank_active_next[0:BANKCOUNT-1];
 reg [ROWBITS-1:0]bank_row[0:BANKCOUNT-1];
 reg [ROWBITS-1:0]bank_row_next[0:BANKCOUNT-1];
 
+// per-bank timing down counters, a command waits for zero
+// - rc: ACTIVE to ACTIVE (tRC)
+// - ras: ACTIVE to PRECHARGE (tRAS = tRC - tRP)
+// - wr: last WRITE to PRECHARGE (tWR)
+// and across banks
+// - rrd: ACTIVE to ACTIVE of another bank (tRRD)
+localparam T_RAS = (T_RC > T_RP) ? (T_RC - T_RP) : 1;
+
+reg [4:0]bank_rc[0:BANKCOUNT-1];
+reg [4:0]bank_rc_next[0:BANKCOUNT-1];
+reg [4:0]bank_ras[0:BANKCOUNT-1];
+reg [4:0]bank_ras_next[0:BANKCOUNT-1];
+reg [4:0]bank_wr[0:BANKCOUNT-1];
+reg [4:0]bank_wr_next[0:BANKCOUNT-1];
+reg [4:0]rrd = 0;
+reg [4:0]rrd_next;
+
+// io_bank may be precharged or activated now
+wire io_pre_ok = (bank_ras[io_bank] == 5'd0) && (bank_wr[io_bank] == 5'd0);
+wire io_act_ok = (bank_rc[io_bank] == 5'd0) && (rrd == 5'd0);
+
+// all banks may be precharged now
+reg pre_all_ok;
+
 // state machine state
 localparam START = 4'd0;
 localparam IDLE = 4'd1;
@@ -201,6 +250,7 @@ always_comb begin
 	data_o_next = data_o;
 	data_oe_next = 0;
 	wr_ack_next = 0;
+	wr_next = 0;
 	rd_rdy_next = 0;
 	rd_ack_next = 0;
 	rd_data_next = rd_data;
@@ -213,9 +263,16 @@ always_comb begin
 	count_done_next = count_done | count[0];
 	count_next = { 1'b0, count[8:1] };
 
+	rrd_next = (rrd == 5'd0) ? rrd : (rrd - 5'd1);
+	pre_all_ok = 1;
 	for (i = 0; i < BANKCOUNT; i++) begin
 		bank_active_next[i] = bank_active[i];
 		bank_row_next[i] = bank_row[i];
+		bank_rc_next[i] = (bank_rc[i] == 5'd0) ? bank_rc[i] : (bank_rc[i] - 5'd1);
+		bank_ras_next[i] = (bank_ras[i] == 5'd0) ? bank_ras[i] : (bank_ras[i] - 5'd1);
+		bank_wr_next[i] = (bank_wr[i] == 5'd0) ? bank_wr[i] : (bank_wr[i] - 5'd1);
+		if ((bank_ras[i] != 5'd0) || (bank_wr[i] != 5'd0))
+			pre_all_ok = 0;
 	end
 
 	// read pipe regs track inbound read data (rdy)
@@ -237,12 +294,14 @@ always_comb begin
 	IDLE: begin
 		if (refresh_done) begin
 			// refresh counter has expired, precharge all and refresh
-			state_next = REFRESH;
-			cmd_next = CMD_PRECHARGE;
-			io_sel_row_next = 0;
-			io_sel_a10_next = 1; // ALL BANKS
-			//count_next = T_RP - 2;
-			count_next[T_RP-2] = 1; count_done_next = 0;
+			if (pre_all_ok) begin
+				state_next = REFRESH;
+				cmd_next = CMD_PRECHARGE;
+				io_sel_row_next = 0;
+				io_sel_a10_next = 1; // ALL BANKS
+				//count_next = T_RP - 2;
+				count_next[T_RP-2] = 1; count_done_next = 0;
+			end
 		end else
 			if (rd_req) begin
 			io_do_rd_next = 1;
@@ -257,16 +316,23 @@ always_comb begin
 			burst_next = wr_len;
 			state_next = START_WRITE;
 			wr_ack_next = 1;
+			wr_next = 1;
 		end
 	end
 	START_READ: begin
-		if (!bank_active[io_bank] || (bank_row[io_bank] != io_row)) begin
+		if (!bank_active[io_bank]) begin
+			// bank is idle, no need to precharge
 			state_next = ACTIVE;
-			cmd_next = CMD_PRECHARGE;
-			io_sel_row_next = 0; // column addr
-			io_sel_a10_next = 0; // one bank only
-			//count_next = T_RP - 2;
-			count_next[T_RP-2] = 1; count_done_next = 0;
+		end else if (bank_row[io_bank] != io_row) begin
+			if (io_pre_ok) begin
+				state_next = ACTIVE;
+				cmd_next = CMD_PRECHARGE;
+				io_sel_row_next = 0; // column addr
+				io_sel_a10_next = 0; // one bank only
+				//count_next = T_RP - 2;
+				count_next[T_RP-2] = 1; count_done_next = 0;
+				bank_active_next[io_bank] = 0;
+			end
 		end else begin
 			cmd_next = CMD_READ;
 			io_sel_row_next = 0; // column addr
@@ -281,30 +347,38 @@ always_comb begin
 			end
 		end
 	end
-	START_WRITE: if (!rd_pipe_bsy[0]) begin
-		if (!bank_active[io_bank] || (bank_row[io_bank] != io_row)) begin
+	START_WRITE: begin
+		// PRECHARGE and ACTIVE may overlap read data still in
+		// flight, only the WRITE itself must wait for the bus
+		if (!bank_active[io_bank]) begin
+			// bank is idle, no need to precharge
 			state_next = ACTIVE;
-			// precharge one bank (a10=0)
-			cmd_next = CMD_PRECHARGE;
-			io_sel_row_next = 0; // column addr
-			io_sel_a10_next = 0; // one bank only
-			//count_next = T_RP - 2;
-			count_next[T_RP-2] = 1; count_done_next = 0;
-		end else begin
+		end else if (bank_row[io_bank] != io_row) begin
+			if (io_pre_ok) begin
+				state_next = ACTIVE;
+				// precharge one bank (a10=0)
+				cmd_next = CMD_PRECHARGE;
+				io_sel_row_next = 0; // column addr
+				io_sel_a10_next = 0; // one bank only
+				//count_next = T_RP - 2;
+				count_next[T_RP-2] = 1; count_done_next = 0;
+				bank_active_next[io_bank] = 0;
+			end
+		end else if (!rd_pipe_bsy[0]) begin
 			cmd_next = CMD_WRITE;
 			io_sel_row_next = 0; // column addr
 			io_sel_a10_next = 0; // no auto precharge
 			data_oe_next = 1;
+			bank_wr_next[io_bank] = T_WR - 1;
 			if (burst == 4'd0) begin
 				state_next = IDLE;
-				burst_next = burst_sub1;
-				count_next[2] = 1; count_done_next = 0; // WR?
 			end else begin
 				state_next = WRITE;
+				burst_next = burst_sub1;
 			end
 		end
 	end
-	ACTIVE: begin
+	ACTIVE: if (io_act_ok) begin
 		state_next = io_do_rd ? START_READ : START_WRITE;
 		//count_next = T_RCD - 2;
 		count_next[T_RCD-2] = 1; count_done_next = 0;
@@ -312,6 +386,9 @@ always_comb begin
 		io_sel_row_next = 1; // row address
 		bank_active_next[io_bank] = 1;
 		bank_row_next[io_bank] = io_row;
+		bank_rc_next[io_bank] = T_RC - 1;
+		bank_ras_next[io_bank] = T_RAS - 1;
+		rrd_next = T_RRD - 1;
 	end
 	READ: begin
 		if (burst == 4'd0) begin
@@ -328,15 +405,16 @@ always_comb begin
 	WRITE: begin
 		if (burst == 4'd0) begin
 			state_next = IDLE;
-			count_next[2] = 1; count_done_next = 0; // WR?
 		end else begin
 			burst_next = burst_sub1;
 		end
 		// column addressing pre-selected from initial write
 		io_addr_next[COLBITS-1:0] = io_col_add1;
 		cmd_next = CMD_WRITE;
-		data_o_next = wr_data; // handshake?
+		data_o_next = wr_data;
 		data_oe_next = 1;
+		wr_next = 1;
+		bank_wr_next[io_bank] = T_WR - 1;
 	end
 	INIT0: if (refresh_done) begin
 		state_next = INIT1;
@@ -398,25 +476,132 @@ always_ff @(posedge clk) begin
 	for (i = 0; i < BANKCOUNT; i++) begin
 		bank_active[i] <= bank_active_next[i];
 		bank_row[i] <= bank_row_next[i];
+		bank_rc[i] <= bank_rc_next[i];
+		bank_ras[i] <= bank_ras_next[i];
+		bank_wr[i] <= bank_wr_next[i];
 	end
+	rrd <= rrd_next;
 	rd_pipe_rdy <= rd_pipe_rdy_next;
 	rd_pipe_bsy <= rd_pipe_bsy_next;
 end
 
+// performance counters, read via perf_addr/perf_data
+localparam PERF_CYCLES = 4'd0;     // clocks since clear
+localparam PERF_BUSY = 4'd1;       // clocks not idle
+localparam PERF_RD_WORDS = 4'd2;   // words read
+localparam PERF_WR_WORDS = 4'd3;   // words written
+localparam PERF_ACTIVATES = 4'd4;  // ACTIVE commands
+localparam PERF_REFRESHES = 4'd5;  // REFRESH commands
+localparam PERF_RF_STALLS = 4'd6;  // clocks a request waited on refresh
+localparam PERF_READS = 4'd7;      // read requests completed
+localparam PERF_LAT_SUM = 4'd8;    // sum of read latencies (req to data)
+localparam PERF_LAT_MAX = 4'd9;    // max read latency
+
+generate
+if (PERF_COUNTERS) begin: perf
+	reg [31:0]ctr[0:9];
+
+	initial begin
+		for (i = 0; i < 10; i++)
+			ctr[i] = 0;
+	end
+
+	// refresh underway: from precharge all until idle again
+	reg in_refresh = 0;
+
+	// read latency: one read is timed at a time, from rd_req to the
+	// first word of its data, skipping data of earlier reads
+	reg [7:0]rd_words_out = 0;
+	reg [7:0]skip = 0;
+	reg timing = 0;
+	reg acked = 0;
+	reg [31:0]lat = 0;
+
+	wire busy = (state != IDLE) || (!count_done) || (rd_pipe_bsy != 0);
+	wire lat_done = timing && acked && rd_rdy && (skip == 8'd0);
+	wire [7:0]rd_words_ack = rd_ack ? ({ 4'd0, burst } + 8'd1) : 8'd0;
+
+	always_ff @(posedge clk) begin
+		if ((state == IDLE) && count_done)
+			in_refresh <= refresh_done;
+
+		rd_words_out <= rd_words_out + rd_words_ack - { 7'd0, rd_rdy };
+
+		lat <= lat + 32'd1;
+		if (!timing) begin
+			if (rd_req && !rd_ack) begin
+				timing <= 1;
+				acked <= 0;
+				lat <= 32'd1;
+			end
+		end else if (!acked) begin
+			if (rd_ack) begin
+				acked <= 1;
+				skip <= rd_words_out - { 7'd0, rd_rdy };
+			end
+		end else if (rd_rdy) begin
+			if (skip == 8'd0)
+				timing <= 0;
+			else
+				skip <= skip - 8'd1;
+		end
+
+		if (perf_clear) begin
+			for (i = 0; i < 10; i++)
+				ctr[i] <= 0;
+		end else begin
+			ctr[PERF_CYCLES] <= ctr[PERF_CYCLES] + 32'd1;
+			if (busy)
+				ctr[PERF_BUSY] <= ctr[PERF_BUSY] + 32'd1;
+			if (rd_rdy)
+				ctr[PERF_RD_WORDS] <= ctr[PERF_RD_WORDS] + 32'd1;
+			if (cmd == CMD_WRITE)
+				ctr[PERF_WR_WORDS] <= ctr[PERF_WR_WORDS] + 32'd1;
+			if (cmd == CMD_ACTIVE)
+				ctr[PERF_ACTIVATES] <= ctr[PERF_ACTIVATES] + 32'd1;
+			if (cmd == CMD_REFRESH)
+				ctr[PERF_REFRESHES] <= ctr[PERF_REFRESHES] + 32'd1;
+			if ((rd_req || wr_req) && (in_refresh || ((state == IDLE) && refresh_done)))
+				ctr[PERF_RF_STALLS] <= ctr[PERF_RF_STALLS] + 32'd1;
+			if (lat_done) begin
+				ctr[PERF_READS] <= ctr[PERF_READS] + 32'd1;
+				ctr[PERF_LAT_SUM] <= ctr[PERF_LAT_SUM] + lat;
+				if (lat > ctr[PERF_LAT_MAX])
+					ctr[PERF_LAT_MAX] <= lat;
+			end
+		end
+	end
+
+	always_comb begin
+		perf_data = (perf_addr < 4'd10) ? ctr[perf_addr] : 32'd0;
+	end
+end else begin: noperf
+	always_comb perf_data = 32'd0;
+end
+endgenerate
+
 assign { ras_n, cas_n, we_n } = cmd;
 
 wire [(ROWBITS-COLBITS)-1:0]io_misc = {{ROWBITS-10-1{1'b0}}, io_sel_a10, {10-COLBITS{1'b0}}};
 wire [ROWBITS-1:0]io_low = io_sel_row ? io_row : { io_misc, io_col };
 assign addr = { io_bank, io_low };
 
-`ifdef verilator
+`ifdef SDRAM_SPLIT_DATA
 assign pin_clk = clk;
 assign pin_ras_n = ras_n;
 assign pin_cas_n = cas_n;
 assign pin_we_n = we_n;
 assign pin_addr = addr;
+assign pin_data_o = data_o;
+assign data_i = pin_data_i;
 
-// TODO: fix me
+`elsif verilator
+// lint only (the board tops), the inout is not simulated
+assign pin_clk = clk;
+assign pin_ras_n = ras_n;
+assign pin_cas_n = cas_n;
+assign pin_we_n = we_n;
+assign pin_addr = addr;
 assign pin_data = data_o;
 assign data_i = pin_data;
 
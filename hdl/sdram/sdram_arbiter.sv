@@ -0,0 +1,318 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// N-port front end for sdram.sv
+//
+// Each port has a request fifo (addr, len, rd/wr) and a write data
+// fifo.  A write request is not issued until all len+1 of its data
+// words are in the data fifo.  Read data is returned in request order
+// on the shared rd_data bus with a per-port rd_rdy strobe.
+//
+// Coalescing: while a port waits for its turn, following requests in
+// the same direction to the next columns of the same row are merged
+// into its pending request, up to a 16 word burst.
+//
+// Arbitration: round robin, except that QOS_PORT has strict priority
+// for up to QOS_WORDS words every QOS_WINDOW clocks (for display
+// scanout, etc).  Past that it competes round robin with the others
+// so it cannot starve them.  QOS_WORDS = 0 disables the priority.
+//
+// Port n of the packed port vectors is bits [n*W +: W].
+
+module sdram_arbiter #(
+	parameter PORTS = 3,
+
+	// must match the sdram controller
+	parameter BANKBITS = 1,
+	parameter ROWBITS = 11,
+	parameter COLBITS = 8,
+	parameter DWIDTH = 16,
+
+	parameter QDEPTH = 2,       // 2^QDEPTH request fifo entries per port
+	parameter QOS_PORT = 0,
+	parameter QOS_WORDS = 0,    // guaranteed words per window
+	parameter QOS_WINDOW = 1024 // window length in clocks
+	) (
+	input wire clk,
+
+	// request ports
+	input wire [PORTS*XWIDTH-1:0]req_addr,
+	input wire [PORTS*4-1:0]req_len,
+	input wire [PORTS-1:0]req_wr,
+	input wire [PORTS-1:0]req_valid,
+	output wire [PORTS-1:0]req_ready,
+
+	// write data ports (16 deep)
+	input wire [PORTS*DWIDTH-1:0]wd_data,
+	input wire [PORTS-1:0]wd_valid,
+	output wire [PORTS-1:0]wd_ready,
+
+	// read data
+	output wire [DWIDTH-1:0]rd_data,
+	output reg [PORTS-1:0]rd_rdy,
+
+	// to the sdram controller
+	output reg [XWIDTH-1:0]sd_rd_addr = 0,
+	output reg [3:0]sd_rd_len = 0,
+	output reg sd_rd_req = 0,
+	input wire sd_rd_ack,
+	input wire [DWIDTH-1:0]sd_rd_data,
+	input wire sd_rd_rdy,
+
+	output reg [XWIDTH-1:0]sd_wr_addr = 0,
+	output wire [DWIDTH-1:0]sd_wr_data,
+	output reg [3:0]sd_wr_len = 0,
+	output reg sd_wr_req = 0,
+	input wire sd_wr_ack,
+	input wire sd_wr_next
+	);
+
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+localparam QWIDTH = (1 + 4 + XWIDTH);
+localparam PBITS = (PORTS > 1) ? $clog2(PORTS) : 1;
+
+integer i;
+integer j;
+
+// ---- per-port fifos ----
+
+wire [QWIDTH-1:0]q_data[0:PORTS-1];
+wire q_valid[0:PORTS-1];
+reg q_ready[0:PORTS-1];
+
+wire [DWIDTH-1:0]w_data[0:PORTS-1];
+wire w_valid[0:PORTS-1];
+reg w_ready[0:PORTS-1];
+
+genvar n;
+generate
+for (n = 0; n < PORTS; n++) begin: port
+	sync_fifo #(
+		.WIDTH(QWIDTH),
+		.DEPTH(QDEPTH)
+		) reqfifo (
+		.clk(clk),
+		.wr_data({ req_wr[n], req_len[n*4 +: 4], req_addr[n*XWIDTH +: XWIDTH] }),
+		.wr_valid(req_valid[n]),
+		.wr_ready(req_ready[n]),
+		.rd_data(q_data[n]),
+		.rd_valid(q_valid[n]),
+		.rd_ready(q_ready[n])
+	);
+	sync_fifo #(
+		.WIDTH(DWIDTH),
+		.DEPTH(4)
+		) wrfifo (
+		.clk(clk),
+		.wr_data(wd_data[n*DWIDTH +: DWIDTH]),
+		.wr_valid(wd_valid[n]),
+		.wr_ready(wd_ready[n]),
+		.rd_data(w_data[n]),
+		.rd_valid(w_valid[n]),
+		.rd_ready(w_ready[n])
+	);
+end
+endgenerate
+
+// ---- per-port pending request (coalescing stage) ----
+
+reg stage_valid[0:PORTS-1];
+reg stage_valid_next[0:PORTS-1];
+reg stage_wr[0:PORTS-1];
+reg stage_wr_next[0:PORTS-1];
+reg [XWIDTH-1:0]stage_addr[0:PORTS-1];
+reg [XWIDTH-1:0]stage_addr_next[0:PORTS-1];
+reg [3:0]stage_len[0:PORTS-1];
+reg [3:0]stage_len_next[0:PORTS-1];
+
+// write data words in the fifo not yet claimed by a request
+reg [4:0]wd_count[0:PORTS-1];
+reg [4:0]wd_count_next[0:PORTS-1];
+
+initial begin
+	for (i = 0; i < PORTS; i++) begin
+		stage_valid[i] = 0;
+		wd_count[i] = 0;
+	end
+end
+
+// ---- read tags: which port each outstanding read belongs to ----
+
+reg [PBITS-1:0]tag_port[0:3];
+reg [3:0]tag_len[0:3];
+reg [2:0]tag_wr = 0;
+reg [2:0]tag_rd = 0;
+reg [3:0]rd_count = 0;
+wire tag_full = (tag_wr[1:0] == tag_rd[1:0]) && (tag_wr[2] != tag_rd[2]);
+wire [PBITS-1:0]rd_port = tag_port[tag_rd[1:0]];
+wire rd_last = (rd_count == tag_len[tag_rd[1:0]]);
+
+assign rd_data = sd_rd_data;
+
+// ---- write data routing ----
+
+// port whose write is being streamed and words still to go
+reg [PBITS-1:0]wr_port = 0;
+reg [4:0]wr_left = 0;
+
+assign sd_wr_data = w_data[wr_port];
+
+// ---- qos ----
+
+reg [15:0]qos_credit = QOS_WORDS;
+reg [15:0]qos_timer = 0;
+
+// ---- arbitration ----
+
+reg elig[0:PORTS-1];
+reg [PBITS-1:0]rr_last = 0;
+reg [PBITS-1:0]grant;
+reg grant_ok;
+reg grant_qos;
+
+// the controller samples one request at a time, the next one may be
+// presented in the cycle the previous one is acked
+wire can_issue = ((!sd_rd_req) && (!sd_wr_req)) ||
+	(sd_rd_req & sd_rd_ack) || (sd_wr_req & sd_wr_ack);
+
+reg q_wr;
+reg [3:0]q_len;
+reg [XWIDTH-1:0]q_addr;
+reg [COLBITS:0]stage_end;
+reg [4:0]merged_len;
+reg take;
+
+always_comb begin
+	for (i = 0; i < PORTS; i++) begin
+		elig[i] = stage_valid[i] && (stage_wr[i] ?
+			((wd_count[i] > { 1'b0, stage_len[i] }) && (wr_left == 5'd0)) :
+			(!tag_full));
+	end
+
+	grant_ok = 0;
+	grant_qos = 0;
+	grant = rr_last;
+	if ((QOS_WORDS != 0) && elig[QOS_PORT] && (qos_credit != 16'd0)) begin
+		grant_ok = 1;
+		grant_qos = 1;
+		grant = QOS_PORT;
+	end else begin
+		for (i = 1; i <= PORTS; i++) begin
+			j = rr_last + i;
+			if (j >= PORTS) j = j - PORTS;
+			if ((!grant_ok) && elig[j]) begin
+				grant_ok = 1;
+				grant = j[PBITS-1:0];
+			end
+		end
+	end
+	grant_ok = grant_ok & can_issue;
+
+	for (i = 0; i < PORTS; i++) begin
+		stage_valid_next[i] = stage_valid[i];
+		stage_wr_next[i] = stage_wr[i];
+		stage_addr_next[i] = stage_addr[i];
+		stage_len_next[i] = stage_len[i];
+		wd_count_next[i] = wd_count[i] + { 4'd0, (wd_valid[i] & wd_ready[i]) };
+		q_ready[i] = 0;
+		w_ready[i] = sd_wr_next && (wr_port == i);
+
+		{ q_wr, q_len, q_addr } = q_data[i];
+		stage_end = { 1'b0, stage_addr[i][COLBITS-1:0] } +
+			{ {COLBITS-4{1'b0}}, stage_len[i] } + 1;
+		merged_len = { 1'b0, stage_len[i] } + { 1'b0, q_len } + 5'd1;
+		take = grant_ok && (grant == i);
+
+		if (take) begin
+			stage_valid_next[i] = 0;
+			if (stage_wr[i])
+				wd_count_next[i] = wd_count_next[i] - { 1'b0, stage_len[i] } - 5'd1;
+		end
+
+		if (q_valid[i]) begin
+			if (take || !stage_valid[i]) begin
+				// load the next request
+				q_ready[i] = 1;
+				stage_valid_next[i] = 1;
+				stage_wr_next[i] = q_wr;
+				stage_addr_next[i] = q_addr;
+				stage_len_next[i] = q_len;
+			end else if ((q_wr == stage_wr[i]) &&
+				(q_addr[XWIDTH-1:COLBITS] == stage_addr[i][XWIDTH-1:COLBITS]) &&
+				({ 1'b0, q_addr[COLBITS-1:0] } == stage_end) &&
+				(merged_len[4] == 1'b0)) begin
+				// continues the pending request, merge it
+				q_ready[i] = 1;
+				stage_len_next[i] = merged_len[3:0];
+			end
+		end
+	end
+
+	for (i = 0; i < PORTS; i++)
+		rd_rdy[i] = sd_rd_rdy && (rd_port == i);
+end
+
+always_ff @(posedge clk) begin
+	for (i = 0; i < PORTS; i++) begin
+		stage_valid[i] <= stage_valid_next[i];
+		stage_wr[i] <= stage_wr_next[i];
+		stage_addr[i] <= stage_addr_next[i];
+		stage_len[i] <= stage_len_next[i];
+		wd_count[i] <= wd_count_next[i];
+	end
+
+	if (sd_rd_req & sd_rd_ack)
+		sd_rd_req <= 0;
+	if (sd_wr_req & sd_wr_ack)
+		sd_wr_req <= 0;
+
+	if (sd_wr_next)
+		wr_left <= wr_left - 5'd1;
+
+	if (grant_ok) begin
+		if (stage_wr[grant]) begin
+			sd_wr_req <= 1;
+			sd_wr_addr <= stage_addr[grant];
+			sd_wr_len <= stage_len[grant];
+			wr_port <= grant;
+			wr_left <= { 1'b0, stage_len[grant] } + 5'd1;
+		end else begin
+			sd_rd_req <= 1;
+			sd_rd_addr <= stage_addr[grant];
+			sd_rd_len <= stage_len[grant];
+			tag_port[tag_wr[1:0]] <= grant;
+			tag_len[tag_wr[1:0]] <= stage_len[grant];
+			tag_wr <= tag_wr + 3'd1;
+		end
+		if (!grant_qos)
+			rr_last <= grant;
+	end
+
+	// read data returns in request order
+	if (sd_rd_rdy) begin
+		if (rd_last) begin
+			rd_count <= 0;
+			tag_rd <= tag_rd + 3'd1;
+		end else begin
+			rd_count <= rd_count + 4'd1;
+		end
+	end
+
+	// refill the qos port's credit every window
+	if (qos_timer == 16'd0) begin
+		qos_timer <= QOS_WINDOW - 1;
+		qos_credit <= QOS_WORDS;
+	end else begin
+		qos_timer <= qos_timer - 16'd1;
+		if (grant_ok && grant_qos) begin
+			if (qos_credit > { 12'd0, stage_len[QOS_PORT] })
+				qos_credit <= qos_credit - { 12'd0, stage_len[QOS_PORT] } - 16'd1;
+			else
+				qos_credit <= 0;
+		end
+	end
+end
+
+endmodule
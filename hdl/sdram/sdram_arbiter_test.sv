@@ -0,0 +1,368 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// sdram_arbiter bench (project test-sdram-arbiter)
+//
+// Port 0 is a display-like port with a QOS guarantee, the others
+// issue random reads and writes.  Every port works in its own 1024
+// word region, which it fills first, and keeps a shadow copy so each
+// read word can be checked against the last write to it.
+//
+// After its fill, port 0 reads its region sequentially in 16 word
+// bursts until the other ports finish.  For each QOS window in which
+// all the other ports are still busy, it must receive at least
+// QOS_WORDS words.
+
+module testbench(
+	input wire clk,
+	output reg error = 0,
+	output reg done = 0
+	);
+
+localparam PORTS = 4;
+localparam BANKBITS = 1;
+localparam ROWBITS = 11;
+localparam COLBITS = 8;
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+
+localparam [15:0]QOS_WORDS = 256;
+localparam [15:0]QOS_WINDOW = 1024;
+
+wire [PORTS*XWIDTH-1:0]req_addr;
+wire [PORTS*4-1:0]req_len;
+wire [PORTS-1:0]req_wr;
+wire [PORTS-1:0]req_valid;
+wire [PORTS-1:0]req_ready;
+
+wire [PORTS*16-1:0]wd_data;
+wire [PORTS-1:0]wd_valid;
+wire [PORTS-1:0]wd_ready;
+
+wire [15:0]rd_data;
+wire [PORTS-1:0]rd_rdy;
+
+wire [PORTS-1:0]p_error;
+wire [PORTS-1:0]p_done;
+wire [PORTS-1:0]p_filled;
+
+// the other ports have all finished issuing
+wire others_done = &p_done[PORTS-1:1];
+
+genvar n;
+generate
+for (n = 0; n < PORTS; n++) begin: port
+	arbiter_test_port #(
+		.N(n),
+		.XWIDTH(XWIDTH),
+		.SEQ(n == 0)
+		) drv (
+		.clk(clk),
+		.stop(others_done),
+		.req_addr(req_addr[n*XWIDTH +: XWIDTH]),
+		.req_len(req_len[n*4 +: 4]),
+		.req_wr(req_wr[n]),
+		.req_valid(req_valid[n]),
+		.req_ready(req_ready[n]),
+		.wd_data(wd_data[n*16 +: 16]),
+		.wd_valid(wd_valid[n]),
+		.wd_ready(wd_ready[n]),
+		.rd_data(rd_data),
+		.rd_rdy(rd_rdy[n]),
+		.error(p_error[n]),
+		.done(p_done[n]),
+		.filled(p_filled[n])
+	);
+end
+endgenerate
+
+wire [XWIDTH-1:0]sd_rd_addr;
+wire [3:0]sd_rd_len;
+wire sd_rd_req;
+wire sd_rd_ack;
+wire [15:0]sd_rd_data;
+wire sd_rd_rdy;
+
+wire [XWIDTH-1:0]sd_wr_addr;
+wire [15:0]sd_wr_data;
+wire [3:0]sd_wr_len;
+wire sd_wr_req;
+wire sd_wr_ack;
+wire sd_wr_next;
+
+sdram_arbiter #(
+	.PORTS(PORTS),
+	.BANKBITS(BANKBITS),
+	.ROWBITS(ROWBITS),
+	.COLBITS(COLBITS),
+	.QOS_PORT(0),
+	.QOS_WORDS(QOS_WORDS),
+	.QOS_WINDOW(QOS_WINDOW)
+	) arbiter (
+	.clk(clk),
+	.req_addr(req_addr),
+	.req_len(req_len),
+	.req_wr(req_wr),
+	.req_valid(req_valid),
+	.req_ready(req_ready),
+	.wd_data(wd_data),
+	.wd_valid(wd_valid),
+	.wd_ready(wd_ready),
+	.rd_data(rd_data),
+	.rd_rdy(rd_rdy),
+	.sd_rd_addr(sd_rd_addr),
+	.sd_rd_len(sd_rd_len),
+	.sd_rd_req(sd_rd_req),
+	.sd_rd_ack(sd_rd_ack),
+	.sd_rd_data(sd_rd_data),
+	.sd_rd_rdy(sd_rd_rdy),
+	.sd_wr_addr(sd_wr_addr),
+	.sd_wr_data(sd_wr_data),
+	.sd_wr_len(sd_wr_len),
+	.sd_wr_req(sd_wr_req),
+	.sd_wr_ack(sd_wr_ack),
+	.sd_wr_next(sd_wr_next)
+);
+
+// sdram_tlm.sv (PROJECT_SDRAM_MODEL := tlm)
+sdram #(
+	.BANKBITS(BANKBITS),
+	.ROWBITS(ROWBITS),
+	.COLBITS(COLBITS)
+	) sdram0 (
+	.clk(clk),
+	.reset(1'b0),
+	.pin_clk(),
+	.pin_ras_n(),
+	.pin_cas_n(),
+	.pin_we_n(),
+	.pin_data_i(16'd0),
+	.pin_data_o(),
+	.pin_addr(),
+	.rd_addr(sd_rd_addr),
+	.rd_len(sd_rd_len),
+	.rd_req(sd_rd_req),
+	.rd_ack(sd_rd_ack),
+	.rd_data(sd_rd_data),
+	.rd_rdy(sd_rd_rdy),
+	.wr_addr(sd_wr_addr),
+	.wr_data(sd_wr_data),
+	.wr_len(sd_wr_len),
+	.wr_req(sd_wr_req),
+	.wr_ack(sd_wr_ack),
+	.wr_next(sd_wr_next),
+	.perf_addr(4'd0),
+	.perf_data(),
+	.perf_clear(1'b0)
+);
+
+// ---- display bandwidth, per QOS window (as the arbiter counts them) ----
+
+reg [31:0]now = 0;
+reg [15:0]win_timer = 0;
+reg [15:0]win_words = 0;
+reg win_check = 0;
+reg [15:0]win_count = 0;
+
+always_ff @(posedge clk) begin
+	now <= now + 32'd1;
+
+	win_words <= win_words + { 15'd0, rd_rdy[0] };
+	if (win_timer == 16'd0) begin
+		win_timer <= QOS_WINDOW - 16'd1;
+		win_words <= { 15'd0, rd_rdy[0] };
+		// only windows where port 0 and all the others were busy
+		if (win_check && !others_done) begin
+			win_count <= win_count + 16'd1;
+			if (win_words < QOS_WORDS) begin
+				$display("%8d: port 0 got %0d words in a QOS window (< %0d)",
+					now, win_words, QOS_WORDS);
+				error <= 1;
+			end
+		end
+		win_check <= p_filled[0] && !others_done;
+	end else begin
+		win_timer <= win_timer - 16'd1;
+	end
+
+	if (|p_error) error <= 1;
+	if (&p_done) begin
+		if (win_count < 16'd8) begin
+			$display("only %0d QOS windows checked", win_count);
+			error <= 1;
+		end else begin
+			$display("ok: %0d QOS windows checked", win_count);
+		end
+		done <= 1;
+	end
+	if (now == 32'd2000000) begin
+		$display("timeout");
+		error <= 1;
+	end
+end
+
+endmodule
+
+// One request port.  Fills its region with 16 word writes, then
+// issues COUNT random reads and writes or, with SEQ, sequential 16
+// word reads until stop.  Read data is checked in request order.
+module arbiter_test_port #(
+	parameter N = 0,
+	parameter XWIDTH = 20,
+	parameter SEQ = 0,
+	parameter COUNT = 2000
+	) (
+	input wire clk,
+	input wire stop,
+
+	output reg [XWIDTH-1:0]req_addr = 0,
+	output reg [3:0]req_len = 0,
+	output reg req_wr = 0,
+	output reg req_valid = 0,
+	input wire req_ready,
+
+	output reg [15:0]wd_data = 0,
+	output reg wd_valid = 0,
+	input wire wd_ready,
+
+	input wire [15:0]rd_data,
+	input wire rd_rdy,
+
+	output reg error = 0,
+	output reg done = 0,
+	output reg filled = 0
+	);
+
+// region: 4 rows of 256 columns, at the top of the address space
+localparam [XWIDTH-1:0]BASE = XWIDTH'(N) << (XWIDTH - 2);
+
+reg [15:0]shadow[0:1023];
+
+// expected read data, in request order
+reg [15:0]expect_data[0:63];
+reg [6:0]ex_wr = 0;
+reg [6:0]ex_rd = 0;
+wire [6:0]ex_count = ex_wr - ex_rd;
+
+wire [31:0]rnd;
+reg rnd_next = 0;
+
+xorshift32 #(
+	.INITVAL(32'hebd5a728 + N)
+	) rng (
+	.clk(clk),
+	.next(rnd_next),
+	.reset(1'b0),
+	.data(rnd)
+);
+
+localparam PICK = 3'd0;
+localparam WDATA = 3'd1;
+localparam REXP = 3'd2;
+localparam REQ = 3'd3;
+localparam DRAIN = 3'd4;
+
+reg [2:0]state = PICK;
+reg [31:0]issued = 0;
+reg [13:0]wseq = 0;
+
+// current request: region index (row, col), length, words done
+reg [1:0]op_row = 0;
+reg [7:0]op_col = 0;
+reg [3:0]op_len = 0;
+reg [3:0]op_k = 0;
+
+// the word op_k of the request (columns wrap within the row)
+wire [9:0]op_idx = { op_row, op_col + { 4'd0, op_k } };
+
+always_ff @(posedge clk) begin
+	rnd_next <= 0;
+
+	// check read data
+	if (rd_rdy) begin
+		if (ex_count == 7'd0) begin
+			$display("port %0d: unexpected read data %04x", N, rd_data);
+			error <= 1;
+		end else begin
+			if (rd_data != expect_data[ex_rd[5:0]]) begin
+				$display("port %0d: read %04x, expected %04x", N,
+					rd_data, expect_data[ex_rd[5:0]]);
+				error <= 1;
+			end
+			ex_rd <= ex_rd + 7'd1;
+		end
+	end
+
+	case (state)
+	PICK: begin
+		op_k <= 0;
+		if (issued < 32'd64) begin
+			// fill
+			op_row <= issued[5:4];
+			op_col <= { issued[3:0], 4'd0 };
+			op_len <= 4'd15;
+			req_wr <= 1;
+			state <= WDATA;
+		end else if (SEQ) begin
+			filled <= 1;
+			op_row <= issued[5:4];
+			op_col <= { issued[3:0], 4'd0 };
+			op_len <= 4'd15;
+			req_wr <= 0;
+			state <= stop ? DRAIN : REXP;
+		end else if (issued < (32'd64 + COUNT)) begin
+			filled <= 1;
+			op_row <= rnd[9:8];
+			op_col <= rnd[7:0];
+			op_len <= rnd[13:10];
+			req_wr <= rnd[31];
+			rnd_next <= 1;
+			state <= rnd[31] ? WDATA : REXP;
+		end else begin
+			state <= DRAIN;
+		end
+	end
+	WDATA: if (!wd_valid) begin
+		wd_valid <= 1;
+		wd_data <= { N[1:0], wseq };
+		wseq <= wseq + 14'd1;
+	end else if (wd_ready) begin
+		shadow[op_idx] <= wd_data;
+		if (op_k == op_len) begin
+			wd_valid <= 0;
+			req_valid <= 1;
+			state <= REQ;
+		end else begin
+			op_k <= op_k + 4'd1;
+			wd_data <= { N[1:0], wseq };
+			wseq <= wseq + 14'd1;
+		end
+	end
+	REXP: if ((op_k != 4'd0) || (ex_count <= (7'd63 - { 3'd0, op_len }))) begin
+		// the expected data for this read, one word per clock
+		expect_data[ex_wr[5:0]] <= shadow[op_idx];
+		ex_wr <= ex_wr + 7'd1;
+		if (op_k == op_len) begin
+			req_valid <= 1;
+			state <= REQ;
+		end else begin
+			op_k <= op_k + 4'd1;
+		end
+	end
+	REQ: if (req_ready) begin
+		req_valid <= 0;
+		issued <= issued + 32'd1;
+		state <= PICK;
+	end
+	DRAIN: if (ex_count == 7'd0) begin
+		done <= 1;
+	end
+	default: ;
+	endcase
+
+	req_addr <= BASE | { {XWIDTH-10{1'b0}}, op_row, op_col };
+	req_len <= op_len;
+end
+
+endmodule
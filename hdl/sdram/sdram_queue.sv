@@ -0,0 +1,308 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// Optional request queue stage for sdram.sv
+//
+// Upstream ports are the same as sdram.sv's (rd_*, wr_*, wr_next),
+// so it can sit between any master (or sdram_arbiter) and the
+// controller (sd_*).
+//
+// Writes are taken into a buffer of 2^WBITS entries of up to 16
+// words and acked right away.  A write that continues the newest
+// entry (next column, same row, fits in 16 words) is merged into it.
+// The newest entry is held open for merging for HOLD clocks after
+// its last write, unless the buffer fills up.
+//
+// Reads go ahead of buffered writes, except writes to the same row
+// (bank and row) as the read, which are drained first, so reads
+// always see earlier writes.  Writes newer than a pending read are
+// never drained ahead of it.  When draining, entries for rows that
+// are open in the controller are picked first.  Hazards are tracked
+// per row, which is cheaper than per column and never unsafe.
+//
+// Read data is passed straight through, in request order.  Only one
+// read is held at a time, so reads are never reordered among
+// themselves (eg toward open rows); only writes are.
+
+module sdram_queue #(
+	// must match the sdram controller
+	parameter BANKBITS = 1,
+	parameter ROWBITS = 11,
+	parameter COLBITS = 8,
+	parameter DWIDTH = 16,
+
+	parameter WBITS = 2,      // 2^WBITS write buffer entries
+	parameter HOLD = 8        // clocks to wait for a write to merge
+	) (
+	input wire clk,
+
+	// upstream, as sdram.sv
+	input wire [XWIDTH-1:0]rd_addr,
+	input wire [3:0]rd_len,
+	input wire rd_req,
+	output reg rd_ack = 0,
+
+	output wire [DWIDTH-1:0]rd_data,
+	output wire rd_rdy,
+
+	input wire [XWIDTH-1:0]wr_addr,
+	input wire [DWIDTH-1:0]wr_data,
+	input wire [3:0]wr_len,
+	input wire wr_req,
+	output reg wr_ack = 0,
+	output wire wr_next,
+
+	// to the sdram controller
+	output reg [XWIDTH-1:0]sd_rd_addr = 0,
+	output reg [3:0]sd_rd_len = 0,
+	output reg sd_rd_req = 0,
+	input wire sd_rd_ack,
+	input wire [DWIDTH-1:0]sd_rd_data,
+	input wire sd_rd_rdy,
+
+	output reg [XWIDTH-1:0]sd_wr_addr = 0,
+	output wire [DWIDTH-1:0]sd_wr_data,
+	output reg [3:0]sd_wr_len = 0,
+	output reg sd_wr_req = 0,
+	input wire sd_wr_ack,
+	input wire sd_wr_next
+	);
+
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+localparam ENTRIES = (1 << WBITS);
+localparam BANKCOUNT = (1 << BANKBITS);
+
+integer i;
+integer k;
+
+assign rd_data = sd_rd_data;
+assign rd_rdy = sd_rd_rdy;
+
+// ---- write buffer ----
+
+reg [DWIDTH-1:0]wbuf[0:ENTRIES*16-1];
+
+reg [ENTRIES-1:0]valid = 0;
+reg [XWIDTH-1:0]ent_addr[0:ENTRIES-1];
+reg [3:0]ent_len[0:ENTRIES-1];
+
+// older[e][n] = entry n was buffered before entry e
+reg [ENTRIES-1:0]older[0:ENTRIES-1];
+
+// newest entry, and whether writes may still merge into it
+reg [WBITS-1:0]tail = 0;
+reg tail_open = 0;
+reg [7:0]hold = 0;
+
+// burst words still being taken from upstream
+reg w_busy = 0;
+reg [WBITS-1:0]w_slot = 0;
+reg [3:0]w_idx = 0;
+reg [3:0]w_left = 0;
+
+// entry being streamed to the controller
+reg [WBITS-1:0]d_slot = 0;
+reg [3:0]d_idx = 0;
+reg [4:0]d_left = 0;
+
+assign sd_wr_data = wbuf[{ d_slot, d_idx }];
+
+// ---- pending read ----
+
+reg rq_valid = 0;
+reg [XWIDTH-1:0]rq_addr = 0;
+reg [3:0]rq_len = 0;
+reg [ENTRIES-1:0]rq_block = 0; // entries that must drain first
+
+// ---- row most recently accessed in each bank, ie open ----
+
+reg [ROWBITS-1:0]open_row[0:BANKCOUNT-1];
+
+initial begin
+	for (i = 0; i < BANKCOUNT; i++)
+		open_row[i] = 0;
+end
+
+// ---- combinational decisions ----
+
+wire [COLBITS-1:0]wr_col = wr_addr[COLBITS-1:0];
+wire [COLBITS-1:0]tail_col = ent_addr[tail][COLBITS-1:0];
+wire [COLBITS:0]tail_end = { 1'b0, tail_col } + { {COLBITS-4{1'b0}}, ent_len[tail] } + 1;
+wire [3:0]tail_idx = ent_len[tail] + 4'd1;
+wire [4:0]merged_len = { 1'b0, ent_len[tail] } + { 1'b0, wr_len } + 5'd1;
+
+wire can_merge = tail_open && valid[tail] &&
+	(wr_addr[XWIDTH-1:COLBITS] == ent_addr[tail][XWIDTH-1:COLBITS]) &&
+	({ 1'b0, wr_col } == tail_end) && (merged_len[4] == 1'b0);
+
+// slots are free if not buffered and not being streamed out
+reg [ENTRIES-1:0]busy;
+reg free_ok;
+reg [WBITS-1:0]free_slot;
+
+// entries that could be drained now, and those hitting an open row
+reg [ENTRIES-1:0]cand;
+reg [ENTRIES-1:0]hit;
+reg drain_ok;
+reg [WBITS-1:0]drain_slot;
+
+// entries in the same row as the upstream read
+reg [ENTRIES-1:0]rd_same;
+
+wire can_issue = ((!sd_rd_req) && (!sd_wr_req)) ||
+	(sd_rd_req & sd_rd_ack) || (sd_wr_req & sd_wr_ack);
+
+// a read is taken in preference to a write in the same cycle
+wire rd_take = rd_req && (!rq_valid) && (!rd_ack);
+wire wr_take = wr_req && (!rd_take) && (!w_busy) && (!wr_ack) && (can_merge || free_ok);
+
+wire issue_rd = can_issue && rq_valid && ((rq_block & valid) == 0);
+wire issue_wr = can_issue && (!issue_rd) && drain_ok && (d_left == 5'd0);
+
+assign wr_next = wr_take || w_busy;
+
+always_comb begin
+	busy = valid;
+	if (d_left != 5'd0)
+		busy[d_slot] = 1;
+
+	free_ok = 0;
+	free_slot = 0;
+	for (i = ENTRIES - 1; i >= 0; i--) begin
+		if (!busy[i]) begin
+			free_ok = 1;
+			free_slot = i[WBITS-1:0];
+		end
+	end
+
+	for (i = 0; i < ENTRIES; i++) begin
+		rd_same[i] = valid[i] &&
+			(ent_addr[i][XWIDTH-1:COLBITS] == rd_addr[XWIDTH-1:COLBITS]);
+
+		// not while words are still being added to it
+		cand[i] = valid[i] && !(w_busy && (w_slot == i)) &&
+			!(wr_req && can_merge && (tail == i));
+		// keep same-row writes in order
+		for (k = 0; k < ENTRIES; k++) begin
+			if (valid[k] && older[i][k] &&
+				(ent_addr[k][XWIDTH-1:COLBITS] == ent_addr[i][XWIDTH-1:COLBITS]))
+				cand[i] = 0;
+		end
+		if (rq_valid) begin
+			// only what the pending read is waiting on
+			if (!rq_block[i])
+				cand[i] = 0;
+		end else if (tail_open && (tail == i) && free_ok) begin
+			// still collecting writes
+			cand[i] = 0;
+		end
+
+		hit[i] = cand[i] && (open_row[ent_addr[i][COLBITS +: BANKBITS]] ==
+			ent_addr[i][COLBITS+BANKBITS +: ROWBITS]);
+	end
+
+	// prefer an open row, else the lowest numbered candidate
+	drain_ok = 0;
+	drain_slot = 0;
+	for (i = ENTRIES - 1; i >= 0; i--) begin
+		if (cand[i]) begin
+			drain_ok = 1;
+			drain_slot = i[WBITS-1:0];
+		end
+	end
+	for (i = ENTRIES - 1; i >= 0; i--) begin
+		if (hit[i])
+			drain_slot = i[WBITS-1:0];
+	end
+end
+
+always_ff @(posedge clk) begin
+	rd_ack <= 0;
+	wr_ack <= 0;
+
+	if (sd_rd_req & sd_rd_ack)
+		sd_rd_req <= 0;
+	if (sd_wr_req & sd_wr_ack)
+		sd_wr_req <= 0;
+
+	// ---- upstream reads ----
+	if (rd_take) begin
+		rd_ack <= 1;
+		rq_valid <= 1;
+		rq_addr <= rd_addr;
+		rq_len <= rd_len;
+		rq_block <= rd_same;
+		// later writes must not join entries drained ahead of it
+		tail_open <= 0;
+	end
+
+	// ---- upstream writes ----
+	if (hold != 8'd0)
+		hold <= hold - 8'd1;
+	else
+		tail_open <= 0;
+
+	if (wr_take) begin
+		wr_ack <= 1;
+		hold <= HOLD;
+		if (can_merge) begin
+			wbuf[{ tail, tail_idx }] <= wr_data;
+			ent_len[tail] <= merged_len[3:0];
+			w_slot <= tail;
+			w_idx <= tail_idx + 4'd1;
+			tail_open <= (merged_len[3:0] != 4'd15);
+		end else begin
+			wbuf[{ free_slot, 4'd0 }] <= wr_data;
+			valid[free_slot] <= 1;
+			ent_addr[free_slot] <= wr_addr;
+			ent_len[free_slot] <= wr_len;
+			older[free_slot] <= valid;
+			for (i = 0; i < ENTRIES; i++)
+				older[i][free_slot] <= 0;
+			tail <= free_slot;
+			tail_open <= (wr_len != 4'd15);
+			w_slot <= free_slot;
+			w_idx <= 4'd1;
+		end
+		w_busy <= (wr_len != 4'd0);
+		w_left <= wr_len;
+	end else if (w_busy) begin
+		wbuf[{ w_slot, w_idx }] <= wr_data;
+		w_idx <= w_idx + 4'd1;
+		w_left <= w_left - 4'd1;
+		if (w_left == 4'd1)
+			w_busy <= 0;
+	end
+
+	// ---- to the controller ----
+	if (sd_wr_next) begin
+		d_idx <= d_idx + 4'd1;
+		d_left <= d_left - 5'd1;
+	end
+
+	if (issue_rd) begin
+		sd_rd_req <= 1;
+		sd_rd_addr <= rq_addr;
+		sd_rd_len <= rq_len;
+		rq_valid <= 0;
+		open_row[rq_addr[COLBITS +: BANKBITS]] <= rq_addr[COLBITS+BANKBITS +: ROWBITS];
+	end else if (issue_wr) begin
+		sd_wr_req <= 1;
+		sd_wr_addr <= ent_addr[drain_slot];
+		sd_wr_len <= ent_len[drain_slot];
+		d_slot <= drain_slot;
+		d_idx <= 4'd0;
+		d_left <= { 1'b0, ent_len[drain_slot] } + 5'd1;
+		valid[drain_slot] <= 0;
+		// the slot may be reused by a write newer than the read
+		rq_block[drain_slot] <= 0;
+		if (tail == drain_slot)
+			tail_open <= 0;
+		open_row[ent_addr[drain_slot][COLBITS +: BANKBITS]] <=
+			ent_addr[drain_slot][COLBITS+BANKBITS +: ROWBITS];
+	end
+end
+
+endmodule
@@ -0,0 +1,315 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// sdram_queue bench (project test-sdram-queue)
+//
+// Issues random reads and writes to a few columns of four rows (two
+// per bank), so reads often hit rows with buffered writes and writes
+// often continue the previous one (and merge).  A shadow copy of the
+// region gives the last write to each word, and every read word is
+// checked against it.  The region is filled first and read back in
+// full at the end.
+//
+// After the fill, a directed sequence blocks a read on two same-row
+// writes while the buffer is full, so a newer write to the address
+// it reads is taken into the slot of the first as soon as that
+// drains.  The read must still return the older data.
+
+module testbench(
+	input wire clk,
+	output reg error = 0,
+	output reg done = 0
+	);
+
+localparam BANKBITS = 1;
+localparam ROWBITS = 11;
+localparam COLBITS = 8;
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+
+localparam COUNT = 4000;
+localparam DIRECTED = 9;
+
+reg [XWIDTH-1:0]rd_addr = 0;
+reg [3:0]rd_len = 0;
+reg rd_req = 0;
+wire rd_ack;
+wire [15:0]rd_data;
+wire rd_rdy;
+
+reg [XWIDTH-1:0]wr_addr = 0;
+wire [15:0]wr_data;
+reg [3:0]wr_len = 0;
+reg wr_req = 0;
+wire wr_ack;
+wire wr_next;
+
+wire [XWIDTH-1:0]sd_rd_addr;
+wire [3:0]sd_rd_len;
+wire sd_rd_req;
+wire sd_rd_ack;
+wire [15:0]sd_rd_data;
+wire sd_rd_rdy;
+
+wire [XWIDTH-1:0]sd_wr_addr;
+wire [15:0]sd_wr_data;
+wire [3:0]sd_wr_len;
+wire sd_wr_req;
+wire sd_wr_ack;
+wire sd_wr_next;
+
+sdram_queue #(
+	.BANKBITS(BANKBITS),
+	.ROWBITS(ROWBITS),
+	.COLBITS(COLBITS)
+	) queue (
+	.clk(clk),
+	.rd_addr(rd_addr),
+	.rd_len(rd_len),
+	.rd_req(rd_req),
+	.rd_ack(rd_ack),
+	.rd_data(rd_data),
+	.rd_rdy(rd_rdy),
+	.wr_addr(wr_addr),
+	.wr_data(wr_data),
+	.wr_len(wr_len),
+	.wr_req(wr_req),
+	.wr_ack(wr_ack),
+	.wr_next(wr_next),
+	.sd_rd_addr(sd_rd_addr),
+	.sd_rd_len(sd_rd_len),
+	.sd_rd_req(sd_rd_req),
+	.sd_rd_ack(sd_rd_ack),
+	.sd_rd_data(sd_rd_data),
+	.sd_rd_rdy(sd_rd_rdy),
+	.sd_wr_addr(sd_wr_addr),
+	.sd_wr_data(sd_wr_data),
+	.sd_wr_len(sd_wr_len),
+	.sd_wr_req(sd_wr_req),
+	.sd_wr_ack(sd_wr_ack),
+	.sd_wr_next(sd_wr_next)
+);
+
+// sdram_tlm.sv (PROJECT_SDRAM_MODEL := tlm)
+sdram #(
+	.BANKBITS(BANKBITS),
+	.ROWBITS(ROWBITS),
+	.COLBITS(COLBITS)
+	) sdram0 (
+	.clk(clk),
+	.reset(1'b0),
+	.pin_clk(),
+	.pin_ras_n(),
+	.pin_cas_n(),
+	.pin_we_n(),
+	.pin_data_i(16'd0),
+	.pin_data_o(),
+	.pin_addr(),
+	.rd_addr(sd_rd_addr),
+	.rd_len(sd_rd_len),
+	.rd_req(sd_rd_req),
+	.rd_ack(sd_rd_ack),
+	.rd_data(sd_rd_data),
+	.rd_rdy(sd_rd_rdy),
+	.wr_addr(sd_wr_addr),
+	.wr_data(sd_wr_data),
+	.wr_len(sd_wr_len),
+	.wr_req(sd_wr_req),
+	.wr_ack(sd_wr_ack),
+	.wr_next(sd_wr_next),
+	.perf_addr(4'd0),
+	.perf_data(),
+	.perf_clear(1'b0)
+);
+
+// region: columns 0-63 of row 0 and 1 in both banks, as
+// { row, bank, col } (the same bit order as the address)
+reg [15:0]shadow[0:255];
+
+// write data is a stream, one word taken per wr_next
+reg [15:0]wd_seq = 0;
+reg [15:0]wd_plan = 0;
+assign wr_data = wd_seq;
+
+// expected read data, in request order
+reg [15:0]expect_data[0:63];
+reg [6:0]ex_wr = 0;
+reg [6:0]ex_rd = 0;
+wire [6:0]ex_count = ex_wr - ex_rd;
+
+wire [31:0]rnd;
+reg rnd_next = 0;
+
+xorshift32 rng (
+	.clk(clk),
+	.next(rnd_next),
+	.reset(1'b0),
+	.data(rnd)
+);
+
+localparam PICK = 3'd0;
+localparam WPLAN = 3'd1;
+localparam WREQ = 3'd2;
+localparam REXP = 3'd3;
+localparam RREQ = 3'd4;
+localparam DRAIN = 3'd5;
+
+reg [2:0]state = PICK;
+reg [31:0]issued = 0;
+reg [31:0]now = 0;
+reg [7:0]pause = 8'd255;
+
+// current request: row and bank, column, length, words done
+reg [1:0]op_row = 0;
+reg [5:0]op_col = 0;
+reg [3:0]op_len = 0;
+reg [3:0]op_k = 0;
+
+// the last write, to continue or read back
+reg [1:0]last_row = 0;
+reg [5:0]last_col = 0;
+reg [6:0]last_end = 0;
+
+wire [7:0]op_idx = { op_row, op_col + { 2'd0, op_k } };
+wire [XWIDTH-1:0]op_addr = { 10'd0, op_row, 2'd0, op_col };
+
+// step of the directed sequence, region the final read back covers
+wire [31:0]dir = issued - 32'd16;
+wire [31:0]rb = issued - (32'd16 + DIRECTED + COUNT);
+
+always_ff @(posedge clk) begin
+	now <= now + 32'd1;
+	rnd_next <= 0;
+
+	if (wr_next)
+		wd_seq <= wd_seq + 16'd1;
+
+	// check read data
+	if (rd_rdy) begin
+		if (ex_count == 7'd0) begin
+			$display("%8d: unexpected read data %04x", now, rd_data);
+			error <= 1;
+		end else begin
+			if (rd_data != expect_data[ex_rd[5:0]]) begin
+				$display("%8d: read %04x, expected %04x", now,
+					rd_data, expect_data[ex_rd[5:0]]);
+				error <= 1;
+			end
+			ex_rd <= ex_rd + 7'd1;
+		end
+	end
+
+	case (state)
+	PICK: begin
+		op_k <= 0;
+		if (issued < 32'd16) begin
+			// fill, 16 words at a time
+			op_row <= issued[3:2];
+			op_col <= { issued[1:0], 4'd0 };
+			op_len <= 4'd15;
+			state <= WPLAN;
+		end else if (issued < (32'd16 + DIRECTED)) begin
+			if (pause != 8'd0) begin
+				// let the fill drain, so the sequence starts with
+				// an empty buffer (entries 0-3 in order)
+				pause <= pause - 8'd1;
+			end else case (dir[3:0])
+			// P, Q and Q2 (row 3) keep the controller busy for
+			// long enough that A, B, E and F fill the buffer and
+			// R (row 0) is blocked on A and B before any drain.
+			// C needs a slot, and gets A's once A has drained.
+			4'd0: begin op_row <= 2'd3; op_col <= 6'd0; op_len <= 4'd15; state <= REXP; end
+			4'd1: begin op_row <= 2'd3; op_col <= 6'd16; op_len <= 4'd15; state <= REXP; end
+			4'd2: begin op_row <= 2'd3; op_col <= 6'd32; op_len <= 4'd0; state <= REXP; end
+			4'd3: begin op_row <= 2'd0; op_col <= 6'd0; op_len <= 4'd0; state <= WPLAN; end
+			4'd4: begin op_row <= 2'd0; op_col <= 6'd8; op_len <= 4'd0; state <= WPLAN; end
+			4'd5: begin op_row <= 2'd1; op_col <= 6'd0; op_len <= 4'd0; state <= WPLAN; end
+			4'd6: begin op_row <= 2'd2; op_col <= 6'd0; op_len <= 4'd0; state <= WPLAN; end
+			4'd7: begin op_row <= 2'd0; op_col <= 6'd0; op_len <= 4'd0; state <= REXP; end
+			default: begin op_row <= 2'd0; op_col <= 6'd0; op_len <= 4'd0; state <= WPLAN; end
+			endcase
+		end else if (issued < (32'd16 + DIRECTED + COUNT)) begin
+			rnd_next <= 1;
+			op_len <= { 1'b0, rnd[12:10] };
+			if (rnd[31] && rnd[30] && (last_end < 7'd48)) begin
+				// continue the last write
+				op_row <= last_row;
+				op_col <= last_end[5:0];
+				state <= WPLAN;
+			end else if (rnd[31]) begin
+				op_row <= rnd[9:8];
+				op_col <= { 1'b0, rnd[4:0] };
+				state <= WPLAN;
+			end else if (rnd[30]) begin
+				// read back the last write
+				op_row <= last_row;
+				op_col <= last_col;
+				state <= REXP;
+			end else begin
+				op_row <= rnd[9:8];
+				op_col <= { 1'b0, rnd[4:0] };
+				state <= REXP;
+			end
+		end else if (issued < (32'd32 + DIRECTED + COUNT)) begin
+			// read back everything
+			op_row <= rb[3:2];
+			op_col <= { rb[1:0], 4'd0 };
+			op_len <= 4'd15;
+			state <= REXP;
+		end else begin
+			state <= DRAIN;
+		end
+	end
+	WPLAN: begin
+		// the data this write will take from the stream
+		shadow[op_idx] <= wd_plan;
+		wd_plan <= wd_plan + 16'd1;
+		if (op_k == op_len) begin
+			last_row <= op_row;
+			last_col <= op_col;
+			last_end <= { 1'b0, op_col } + { 3'd0, op_len } + 7'd1;
+			wr_addr <= op_addr;
+			wr_len <= op_len;
+			wr_req <= 1;
+			state <= WREQ;
+		end else begin
+			op_k <= op_k + 4'd1;
+		end
+	end
+	WREQ: if (wr_ack) begin
+		wr_req <= 0;
+		issued <= issued + 32'd1;
+		state <= PICK;
+	end
+	REXP: if ((op_k != 4'd0) || (ex_count <= (7'd63 - { 3'd0, op_len }))) begin
+		expect_data[ex_wr[5:0]] <= shadow[op_idx];
+		ex_wr <= ex_wr + 7'd1;
+		if (op_k == op_len) begin
+			rd_addr <= op_addr;
+			rd_len <= op_len;
+			rd_req <= 1;
+			state <= RREQ;
+		end else begin
+			op_k <= op_k + 4'd1;
+		end
+	end
+	RREQ: if (rd_ack) begin
+		rd_req <= 0;
+		issued <= issued + 32'd1;
+		state <= PICK;
+	end
+	DRAIN: if (ex_count == 7'd0) begin
+		$display("ok: %0d requests, %0d words written", issued, wd_seq);
+		done <= 1;
+	end
+	default: ;
+	endcase
+
+	if (now == 32'd1000000) begin
+		$display("timeout");
+		error <= 1;
+	end
+end
+
+endmodule
@@ -0,0 +1,140 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+`default_nettype none
+
+// Transaction-level stand-in for sdram.sv, for simulation only
+//
+// Same module name, parameters, and ports as sdram.sv, but requests
+// are served from a C++ memory (src/sim-sdram.cpp) via DPI instead
+// of driving SDRAM pins, so no pin-level SDRAM model is run.  The
+// pins are held idle (NOP) and there are no performance counters.
+//
+// Request semantics match sdram.sv: rd_ack/wr_ack are pulsed the
+// cycle after a request is accepted, read data returns as rd_len+1
+// rd_rdy pulses on consecutive cycles (columns wrap within the row),
+// and write words after the first are taken from wr_data on the
+// cycles wr_next is asserted.  The delay from read ack to first data
+// comes from the model (-sdram TLM_LATENCY=n,TLM_JITTER=n).
+// Requests are served one at a time.
+
+module sdram #(
+	parameter BANKBITS = 1,
+	parameter ROWBITS = 11,
+	parameter COLBITS = 8,
+	parameter DWIDTH = 16,
+	parameter T_RI = 1900,
+	parameter T_RC = 8,
+	parameter T_RCD = 3,
+	parameter T_RRD = 3,
+	parameter T_RP = 3,
+	parameter T_WR = 2,
+	parameter T_MRD = 3,
+	parameter T_PWR_UP = 25000,
+	parameter CLK_SHIFT = 0,
+	parameter CLK_DELAY = 0,
+	parameter PERF_COUNTERS = 0
+	) (
+	input wire clk,
+	input wire reset,
+	output wire pin_clk,
+	output wire pin_ras_n,
+	output wire pin_cas_n,
+	output wire pin_we_n,
+	input wire [DWIDTH-1:0]pin_data_i,
+	output wire [DWIDTH-1:0]pin_data_o,
+	output wire [AWIDTH-1:0]pin_addr,
+
+	input wire [XWIDTH-1:0]rd_addr,
+	input wire [3:0]rd_len,
+	input wire rd_req,
+	output reg rd_ack = 0,
+
+	output reg [DWIDTH-1:0]rd_data,
+	output reg rd_rdy = 0,
+
+	input wire [XWIDTH-1:0]wr_addr,
+	input wire [DWIDTH-1:0]wr_data,
+	input wire [3:0]wr_len,
+	input wire wr_req,
+	output reg wr_ack = 0,
+	output wire wr_next,
+
+	input wire [3:0]perf_addr,
+	output wire [31:0]perf_data,
+	input wire perf_clear
+	);
+
+import "DPI-C" function int dpi_sdram_tlm_read(input int addr);
+import "DPI-C" function void dpi_sdram_tlm_write(input int addr, input int data);
+import "DPI-C" function int dpi_sdram_tlm_latency();
+
+localparam AWIDTH = (ROWBITS + BANKBITS);
+localparam XWIDTH = (ROWBITS + BANKBITS + COLBITS);
+
+assign pin_clk = clk;
+assign pin_ras_n = 1'b1;
+assign pin_cas_n = 1'b1;
+assign pin_we_n = 1'b1;
+assign pin_addr = 0;
+assign pin_data_o = 0;
+assign perf_data = 0;
+
+localparam IDLE = 2'd0;
+localparam WAIT = 2'd1;
+localparam READ = 2'd2;
+localparam WRITE = 2'd3;
+
+reg [1:0]state = IDLE;
+reg [XWIDTH-1:0]addr = 0;
+reg [3:0]burst = 0;
+integer delay = 0;
+
+// wr_data is taken at the end of this cycle
+assign wr_next = (!reset) && (((state == IDLE) && (!rd_req) && wr_req) || (state == WRITE));
+
+// next column, wrapping within the row as sdram.sv does
+wire [XWIDTH-1:0]addr_add1 = { addr[XWIDTH-1:COLBITS], addr[COLBITS-1:0] + {{COLBITS-1{1'b0}},1'b1} };
+
+always_ff @(posedge clk) begin
+	rd_ack <= 0;
+	wr_ack <= 0;
+	rd_rdy <= 0;
+	if (reset) begin
+		state <= IDLE;
+	end else case (state)
+	IDLE: if (rd_req) begin
+		rd_ack <= 1;
+		addr <= rd_addr;
+		burst <= rd_len;
+		delay <= dpi_sdram_tlm_latency();
+		state <= WAIT;
+	end else if (wr_req) begin
+		wr_ack <= 1;
+		dpi_sdram_tlm_write({ {32-XWIDTH{1'b0}}, wr_addr }, { {32-DWIDTH{1'b0}}, wr_data });
+		addr <= wr_addr;
+		burst <= wr_len;
+		state <= (wr_len == 4'd0) ? IDLE : WRITE;
+	end
+	WAIT: if (delay <= 1) begin
+		state <= READ;
+	end else begin
+		delay <= delay - 1;
+	end
+	READ: begin
+		rd_rdy <= 1;
+		rd_data <= DWIDTH'(dpi_sdram_tlm_read({ {32-XWIDTH{1'b0}}, addr }));
+		addr <= addr_add1;
+		burst <= burst - 4'd1;
+		if (burst == 4'd0) state <= IDLE;
+	end
+	WRITE: begin
+		dpi_sdram_tlm_write({ {32-XWIDTH{1'b0}}, addr_add1 }, { {32-DWIDTH{1'b0}}, wr_data });
+		addr <= addr_add1;
+		burst <= burst - 4'd1;
+		if (burst == 4'd1) state <= IDLE;
+	end
+	endcase
+end
+
+endmodule
@@ -0,0 +1,87 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#ifndef _A16_H_
+#define _A16_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// a16 (src/a16v5.c) and d16 (src/d16v5.c) as a library
+//
+// An a16 context holds one assembled program and all assembler state,
+// so contexts are independent and each thread can use its own.  A
+// context may be reused: each a16_assemble*() replaces the previous
+// program, and is much cheaper than a new context.
+//
+// Functions returning int return 0 on success, or -1 on error with a
+// message from a16_error() (valid until the next call).
+//
+// Build with src/a16v5.c compiled with -DA16_LIBRARY (no main) plus
+// src/d16v5.c, or link out/liba16.a.
+
+struct a16;
+
+#define A16_OBJ 1  // keep relocations for l16 (a16_save_obj), like -obj
+
+struct a16 *a16_new(unsigned flags);
+void a16_free(struct a16 *a);
+
+const char *a16_error(struct a16 *a);
+
+// name is used in messages and to find INCLUDEd files
+int a16_assemble(struct a16 *a, const char *name, const char *text, unsigned len);
+int a16_assemble_file(struct a16 *a, const char *fn);
+
+// the program's words, valid until the next a16_assemble*()
+const uint16_t *a16_words(struct a16 *a, unsigned *count);
+
+// reorder instructions to avoid stalls, like -sched
+struct a16_sched_stats {
+	unsigned blocks;
+	unsigned moved;
+	unsigned stalls_before;
+	unsigned stalls_after;
+};
+void a16_schedule(struct a16 *a, struct a16_sched_stats *stats);
+
+int a16_save_hex(struct a16 *a, const char *fn);
+int a16_save_bin(struct a16 *a, const char *fn);
+int a16_save_ihex(struct a16 *a, const char *fn);
+int a16_save_lst(struct a16 *a, const char *fn);
+int a16_save_obj(struct a16 *a, const char *fn);
+
+// the same, to an open stream (which may be an open_memstream() or
+// fmemopen() buffer), left open
+int a16_write_hex(struct a16 *a, FILE *fp);
+int a16_write_bin(struct a16 *a, FILE *fp);
+int a16_write_ihex(struct a16 *a, FILE *fp);
+int a16_write_lst(struct a16 *a, FILE *fp);
+int a16_write_obj(struct a16 *a, FILE *fp);
+
+// disassemble the instruction at pc into buf (at least 64 bytes)
+void disassemble(char *buf, unsigned pc, unsigned instr);
+
+// bulk disassembly from a table of all 64K instruction words, built
+// by d16_init() (call it before using d16 from several threads)
+int d16_init(void);
+
+// symbols by address, from an a16 listing (-lst) or l16 map (-map)
+struct d16_symbols;
+struct d16_symbols *d16_symbols_load(const char *fn);
+void d16_symbols_free(struct d16_symbols *syms);
+const char *d16_symbol(struct d16_symbols *syms, unsigned addr);
+
+#define D16_SYMBOL_MAX 63  // longer names are truncated
+#define D16_LINE_MAX 256   // most output per word
+
+// disassemble count words at pc (and on) into out, which must hold
+// count * D16_LINE_MAX bytes, as "addr: word  instruction\n" lines
+// with a "label:" line before labelled words and "<label>" after
+// branch targets (syms may be null), returning the bytes written
+// (not nul terminated)
+size_t d16_disassemble_words(char *out, const uint16_t *words, unsigned count,
+	unsigned pc, struct d16_symbols *syms);
+
+#endif
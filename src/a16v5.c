@@ -7,26 +7,107 @@
 #include <ctype.h>
 #include <strings.h>
 #include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#include "a16.h"
 
 typedef unsigned u32;
 typedef unsigned short u16;
 
-static unsigned linenumber = 0;
-static char linestring[256];
-static char *filename;
+#define MAXSECTIONS 256
+#define MAXFILES 256
+#define KEYWORD_HASH 256
+
+struct label;
+struct fixup;
+struct section;
+struct reloc;
+struct macro;
+
+struct srcfile {
+	char *name;
+	const char *text;  // kept for later passes
+	unsigned len;
+	unsigned owned;    // text was read by a16 (else the caller's)
+};
+
+// all assembler state, so that contexts are independent
+struct a16 {
+	unsigned flags;
+
+	// errors longjmp back to the public entry point
+	jmp_buf jmp;
+	char error[1024];
+
+	unsigned linenumber;
+	char linestring[256];
+	const char *filename;
+
+	u16 rom[65536];
+	u16 PC;
+
+	// per word: source line and file (for the listing), section, and
+	// whether the scheduler may move it (set per line by assemble_line)
+	unsigned romline[65536];
+	unsigned char romfile[65536];
+	unsigned char romsect[65536];
+	unsigned char rommovable[65536];
+	unsigned movable;
+
+	// register values known at this point (for LI), forgotten when a
+	// register is written, at labels, and after calls
+	unsigned known_mask;
+	u16 known_val[8];
+
+	// branch relaxation
+	unsigned char *site_form;
+	unsigned site_max;
+	unsigned site_count;
+	unsigned relax;
+	int scratch_reg;
 
-FILE *ofp = 0;
+	// labels are also kept in a hash table (chained, grown to keep
+	// chains short) and indexed by pc for the listing
+	struct label *labels;
+	struct label **label_hash;
+	unsigned label_hash_size;
+	unsigned label_count;
+	struct label *label_at[65536];
 
-void die(const char *fmt, ...) {
+	struct section *sections;
+	unsigned section_count;
+	unsigned objmode;
+	struct reloc *relocs;
+
+	struct srcfile files[MAXFILES];
+	unsigned file_count;
+	unsigned curfile;
+
+	struct macro *macros;
+	struct macro *defining;
+	unsigned expansions;
+	unsigned nesting;
+
+	struct a16_sched_stats sched;
+
+	unsigned char keyword_hash[KEYWORD_HASH];
+};
+
+__attribute__((noreturn))
+static void die(struct a16 *a, const char *fmt, ...) {
 	va_list ap;
-	fprintf(stderr,"%s:%d: ", filename, linenumber);
-	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
-	va_end(ap);
-	fprintf(stderr,"\n");
-	if (linestring[0])
-		fprintf(stderr,"%s:%d: >> %s <<\n", filename, linenumber, linestring);
-	exit(1);
+	unsigned max = sizeof(a->error);
+	unsigned n = snprintf(a->error, max, "%s:%d: ", a->filename, a->linenumber);
+	if (n < max) {
+		va_start(ap, fmt);
+		n += vsnprintf(a->error + n, max - n, fmt, ap);
+		va_end(ap);
+	}
+	if (a->linestring[0] && (n < max))
+		snprintf(a->error + n, max - n, "\n%s:%d: >> %s <<",
+			a->filename, a->linenumber, a->linestring);
+	longjmp(a->jmp, 1);
 }
 
 // various fields
@@ -59,167 +140,561 @@ static inline unsigned _U6(unsigned n) {
 	return ((n & 3) << 6) | ((n & 0x38) << 9);
 }
 
-int is_unsigned6(unsigned n) {
+static int is_unsigned6(unsigned n) {
 	return ((n & 0xFFC0) == 0);
 }
 
-int is_signed7(unsigned n) {
+static int is_signed7(unsigned n) {
 	n &= 0xFFFFFFC0;
 	return ((n == 0) || (n == 0xFFFFFFC0));
 }
-int is_signed9(unsigned n) {
+static int is_signed9(unsigned n) {
 	n &= 0xFFFFFF00;
 	return ((n == 0) || (n == 0xFFFFFF00));
 }
-int is_signed10(unsigned n) {
+static int is_signed10(unsigned n) {
 	n &= 0xFFFFFE00;
 	return ((n == 0) || (n == 0xFFFFFE00));
 }
-int is_signed12(unsigned n) {
+static int is_signed12(unsigned n) {
 	n &= 0xFFFFF800;
 	return ((n == 0) || (n == 0xFFFFF800));
 }
 
-u16 rom[65535];
-u16 PC = 0;
-
 #define TYPE_PCREL_S9	1
 #define TYPE_PCREL_S12	2
 #define TYPE_ABS_U16	3
+#define TYPE_ABS_MOVMHI	4	// MOV Rx, lo10 + MHI Rx, Rx, hi6
 
 struct fixup {
 	struct fixup *next;
 	unsigned pc;
 	unsigned type;
+	int site;
+	const char *filename; // where the label is used, for errors
+	unsigned linenumber;
 };
 
+// Branch relaxation:
+// Each branch to a label is a "site", numbered in source order, with
+// a form that starts at the shortest encoding.  When a site's target
+// is out of range its form is grown and the source is assembled again,
+// until a pass needs no changes.  Forms only grow, so distances only
+// grow and this terminates.
+//
+// B/BL label     0: B s12
+//                1: MOV Rx, lo; MHI Rx, hi; B Rx  (BL uses LR as Rx)
+// BZ/BNZ Rc, lab 0: BZ Rc, s9
+//                1: BNZ Rc, 1; B s12
+//                2: BNZ Rc, 3; MOV Rx, lo; MHI Rx, hi; B Rx
+//
+// Rx for long branches is set by "SCRATCH Rn".
+
+static unsigned newsite(struct a16 *a) {
+	if (a->site_count == a->site_max) {
+		unsigned max = a->site_max ? a->site_max * 2 : 1024;
+		a->site_form = realloc(a->site_form, max);
+		if (!a->site_form) die(a, "out of memory");
+		memset(a->site_form + a->site_max, 0, max - a->site_max);
+		a->site_max = max;
+	}
+	return a->site_count++;
+}
+
 struct label {
 	struct label *next;
+	struct label *hnext;
 	struct fixup *fixups;
 	const char *name;
+	unsigned hash;
 	unsigned pc;
 	unsigned defined;
+	unsigned global;
+	unsigned section;
+};
+
+// Sections and object files (-obj):
+// "SECTION name [, region]" starts a new section, in region code
+// unless another (data, vram, io, ...) is named.  Regions are placed
+// by l16.  With -obj, references that are absolute or cross sections
+// are written out as relocations for l16, which may then place each
+// section anywhere in its region, or drop it if nothing uses it.
+// Without -obj sections are laid out in source order.
+
+struct section {
+	char *name;
+	char *region;
+	unsigned start;
+	unsigned end;
 };
 
-struct label *labels;
-struct fixup *fixups;
+struct reloc {
+	struct reloc *next;
+	struct label *label;
+	unsigned pc;
+	unsigned type;
+};
+
+static void newsection(struct a16 *a, const char *name, const char *region) {
+	struct section *s = 0;
+	if (a->section_count)
+		s = a->sections + a->section_count - 1;
+	if ((s == 0) || (s->start != a->PC)) {
+		// the previous section (if any) ends here
+		if (a->section_count == MAXSECTIONS) die(a, "too many sections");
+		if (s) s->end = a->PC;
+		s = a->sections + a->section_count++;
+	} else {
+		// nothing in the current section yet, just rename it
+		free(s->name);
+		free(s->region);
+	}
+	s->name = strdup(name);
+	s->region = strdup(region);
+	if (!s->name || !s->region) die(a, "out of memory");
+	s->start = a->PC;
+	s->end = a->PC;
+}
+
+static void resetsections(struct a16 *a) {
+	while (a->section_count > 0) {
+		a->section_count--;
+		free(a->sections[a->section_count].name);
+		free(a->sections[a->section_count].region);
+	}
+	newsection(a, "text", "code");
+}
+
+// case-insensitive, as label names are
+static unsigned hashname(const char *s) {
+	unsigned h = 2166136261U;
+	while (*s) {
+		h ^= tolower(*s++);
+		h *= 16777619U;
+	}
+	return h;
+}
 
-void fixup_branch(const char *name, int addr, int btarget, int type) {
+static void label_hash_grow(struct a16 *a) {
+	unsigned size = a->label_hash_size ? a->label_hash_size * 2 : 1024;
+	struct label **tbl = calloc(size, sizeof(*tbl));
+	struct label *l;
+	if (!tbl) die(a, "out of memory");
+	for (l = a->labels; l; l = l->next) {
+		l->hnext = tbl[l->hash & (size - 1)];
+		tbl[l->hash & (size - 1)] = l;
+	}
+	free(a->label_hash);
+	a->label_hash = tbl;
+	a->label_hash_size = size;
+}
+
+static struct label *findlabel(struct a16 *a, const char *name, unsigned hash) {
+	struct label *l;
+	if (a->label_hash == 0) return 0;
+	for (l = a->label_hash[hash & (a->label_hash_size - 1)]; l; l = l->hnext)
+		if ((l->hash == hash) && !strcasecmp(l->name, name))
+			return l;
+	return 0;
+}
+
+static struct label *newlabel(struct a16 *a, const char *name, unsigned hash) {
+	struct label *l = malloc(sizeof(*l));
+	if (!l) die(a, "out of memory");
+	if (!(l->name = strdup(name))) {
+		free(l);
+		die(a, "out of memory");
+	}
+	l->hash = hash;
+	l->pc = 0;
+	l->fixups = 0;
+	l->defined = 0;
+	l->global = 0;
+	l->section = 0;
+	l->next = a->labels;
+	a->labels = l;
+	if (++a->label_count > a->label_hash_size) {
+		label_hash_grow(a);
+	} else {
+		l->hnext = a->label_hash[hash & (a->label_hash_size - 1)];
+		a->label_hash[hash & (a->label_hash_size - 1)] = l;
+	}
+	return l;
+}
+
+static void fixup_branch(struct a16 *a, const char *name, int addr, int btarget, int type, int site) {
 	unsigned n;
 
 	switch(type) {
 	case TYPE_PCREL_S9:
 		n = btarget - addr - 1;
 		if (!is_signed9(n)) break;
-		rom[addr] |= _I9(n);
+		a->rom[addr] |= _I9(n);
 		return;
 	case TYPE_PCREL_S12:
 		n = btarget - addr - 1;
 		if (!is_signed12(n)) break;
-		rom[addr] |= _I12(n);
+		a->rom[addr] |= _I12(n);
 		return;
 	case TYPE_ABS_U16:
-		rom[addr] = btarget;
+		a->rom[addr] = btarget;
+		return;
+	case TYPE_ABS_MOVMHI:
+		a->rom[addr] |= _I10(btarget);
+		a->rom[addr + 1] |= _I7(btarget >> 10);
 		return;
 	default:
-		die("unknown branch type %d\n",type);
+		die(a, "unknown branch type %d\n",type);
 	}
-	die("label '%s' at %08x is out of range of %08x\n", name, btarget, addr);
+	if (site >= 0) {
+		// try a longer form next pass
+		a->site_form[site]++;
+		a->relax = 1;
+		return;
+	}
+	die(a, "label '%s' at %08x is out of range of %08x\n", name, btarget, addr);
+}
+
+static void addreloc(struct a16 *a, struct label *l, unsigned pc, unsigned type) {
+	struct reloc *r = malloc(sizeof(*r));
+	if (!r) die(a, "out of memory");
+	r->label = l;
+	r->pc = pc;
+	r->type = type;
+	r->next = a->relocs;
+	a->relocs = r;
+	// the linker patches these words where they are
+	a->rommovable[pc] = 0;
+	if (type == TYPE_ABS_MOVMHI)
+		a->rommovable[pc + 1] = 0;
 }
 
-void setlabel(const char *name, unsigned pc) {
+// with -obj, absolute and cross-section references are left to l16
+static void resolve(struct a16 *a, struct label *l, unsigned pc, unsigned type, int site) {
+	if (a->objmode && ((type == TYPE_ABS_U16) || (type == TYPE_ABS_MOVMHI) ||
+		(a->romsect[pc] != l->section))) {
+		addreloc(a, l, pc, type);
+		return;
+	}
+	fixup_branch(a, l->name, pc, l->pc, type, site);
+}
+
+static void setlabel(struct a16 *a, const char *name, unsigned pc) {
+	unsigned hash = hashname(name);
 	struct label *l;
 	struct fixup *f;
 
-	for (l = labels; l; l = l->next) {
-		if (!strcasecmp(l->name, name)) {
-			if (l->defined) die("cannot redefine '%s'", name);
-			l->pc = pc;
-			l->defined = 1;
-			for (f = l->fixups; f; f = f->next) {
-				fixup_branch(name, f->pc, l->pc, f->type);
-			}
-			return;
+	// anything may branch here
+	a->known_mask = 0;
+
+	if ((l = findlabel(a, name, hash))) {
+		if (l->defined) die(a, "cannot redefine '%s'", name);
+		l->pc = pc;
+		l->defined = 1;
+		l->section = a->section_count - 1;
+		for (f = l->fixups; f; f = f->next) {
+			resolve(a, l, f->pc, f->type, f->site);
 		}
+	} else {
+		l = newlabel(a, name, hash);
+		l->pc = pc;
+		l->defined = 1;
+		l->section = a->section_count - 1;
 	}
-	l = malloc(sizeof(*l));
-	l->name = strdup(name);
-	l->pc = pc;
-	l->fixups = 0;
-	l->defined = 1;
-	l->next = labels;
-	labels = l;
+	a->label_at[pc & 0xFFFF] = l;
 }
 
-const char *getlabel(unsigned pc) {
-	struct label *l;
-	for (l = labels; l; l = l->next)
-		if (l->pc == pc)
-			return l->name;
-	return 0;
+static const char *getlabel(struct a16 *a, unsigned pc) {
+	struct label *l = a->label_at[pc & 0xFFFF];
+	return l ? l->name : 0;
 }
 
-void uselabel(const char *name, unsigned pc, unsigned type) {
+static void uselabel(struct a16 *a, const char *name, unsigned pc, unsigned type, int site) {
+	unsigned hash = hashname(name);
 	struct label *l;
 	struct fixup *f;
 
-	for (l = labels; l; l = l->next) {
-		if (!strcasecmp(l->name, name)) {
-			if (l->defined) {
-				fixup_branch(name, pc, l->pc, type);
-				return;
-			} else {
-				goto add_fixup;
-			}
+	if ((l = findlabel(a, name, hash))) {
+		if (l->defined) {
+			resolve(a, l, pc, type, site);
+			return;
 		}
+	} else {
+		l = newlabel(a, name, hash);
 	}
-	l = malloc(sizeof(*l));
-	l->name = strdup(name);
-	l->pc = 0;
-	l->fixups = 0;
-	l->defined = 0;
-	l->next = labels;
-	labels = l;
-add_fixup:
-	f = malloc(sizeof(*f));
+	if (!(f = malloc(sizeof(*f)))) die(a, "out of memory");
 	f->pc = pc;
 	f->type = type;
+	f->site = site;
+	f->filename = a->filename;
+	f->linenumber = a->linenumber;
 	f->next = l->fixups;
 	l->fixups = f;
 }
 
-void checklabels(void) {
+// forget label addresses, fixups, and relocations before another pass
+static void resetlabels(struct a16 *a) {
 	struct label *l;
-	for (l = labels; l; l = l->next) {
-		if (!l->defined) {
-			die("undefined label '%s'", l->name);
+	struct fixup *f;
+	struct reloc *r;
+	for (l = a->labels; l; l = l->next) {
+		while ((f = l->fixups)) {
+			l->fixups = f->next;
+			free(f);
 		}
+		if (l->defined)
+			a->label_at[l->pc & 0xFFFF] = 0;
+		l->pc = 0;
+		l->defined = 0;
+		l->global = 0;
+		l->section = 0;
+	}
+	while ((r = a->relocs)) {
+		a->relocs = r->next;
+		free(r);
+	}
+}
+
+static void checklabels(struct a16 *a) {
+	struct label *l;
+	struct fixup *f;
+	for (l = a->labels; l; l = l->next) {
+		if (l->defined) continue;
+		// report the first use (fixups are newest first)
+		for (f = l->fixups; f; f = f->next) {
+			a->filename = f->filename;
+			a->linenumber = f->linenumber;
+		}
+		if (l->global) die(a, "undefined global '%s'", l->name);
+		if (!a->objmode) die(a, "undefined label '%s'", l->name);
+		// external, resolved by l16
+		for (f = l->fixups; f; f = f->next)
+			addreloc(a, l, f->pc, f->type);
 	}
 }
 	
 void disassemble(char *buf, unsigned pc, unsigned instr);
 	
-void emit(unsigned instr) {
-	rom[PC++] = instr;
+
+// registers read and written (bitmasks) as cpu16's hazard logic sees
+// them, which may include reads the instruction does not need, plus
+// LC and SC's Rc (control registers are not implemented yet, but
+// known values and scheduling must not assume Rc survives LC)
+static void regusage(unsigned ir, unsigned *rd, unsigned *wr) {
+	unsigned a = 1 << ((ir >> 6) & 7);
+	unsigned b = 1 << ((ir >> 9) & 7);
+	unsigned c = 1 << ((ir >> 3) & 7);
+	*rd = 0;
+	*wr = 0;
+	switch (ir & 7) {
+	case 0: *rd = a | b; *wr = c; break; // ALU
+	case 1: *rd = a | b; *wr = c; break; // ADD si7 (b from imm bits)
+	case 2: *wr = c; break; // MOV si10
+	case 3: *rd = a; *wr = c; break; // LW
+	case 4: *rd = c; break; // BZ/BNZ
+	case 5: *rd = a | c; break; // SW
+	case 6: if (ir & 8) *wr = 0x80; break; // B/BL si12
+	case 7:
+		if (ir & 0x8000) { // MHI
+			*rd = a;
+			*wr = c;
+		} else if (((ir >> 9) & 7) == 0) { // B/BL Ra
+			*rd = a;
+			if (ir & 8) *wr = 0x80;
+		} else if (((ir >> 9) & 6) == 6) { // shifts
+			*rd = a;
+			*wr = c;
+		} else if (((ir >> 9) & 7) == 4) { // LC
+			*wr = c;
+		} else if (((ir >> 9) & 7) == 5) { // SC
+			*rd = c;
+		}
+		break;
+	}
+}
+
+static unsigned addfile(struct a16 *a, const char *fn) {
+	unsigned n;
+	for (n = 0; n < a->file_count; n++)
+		if (!strcmp(a->files[n].name, fn))
+			return n;
+	if (a->file_count == MAXFILES) die(a, "too many source files");
+	if (!(a->files[n].name = strdup(fn))) die(a, "out of memory");
+	a->files[n].text = 0;
+	a->files[n].len = 0;
+	a->files[n].owned = 0;
+	return a->file_count++;
+}
+
+// read a source file once, for all passes
+static void loadfile(struct a16 *a, struct srcfile *f) {
+	char *text = 0, *tmp;
+	unsigned len = 0, max = 0;
+	size_t r;
+
+	FILE *fp = fopen(f->name, "r");
+	if (!fp) die(a, "cannot open '%s'", f->name);
+	for (;;) {
+		if (len == max) {
+			max = max ? max * 2 : 65536;
+			if (!(tmp = realloc(text, max))) {
+				free(text);
+				fclose(fp);
+				die(a, "out of memory");
+			}
+			text = tmp;
+		}
+		if ((r = fread(text + len, 1, max - len, fp)) == 0)
+			break;
+		len += r;
+	}
+	fclose(fp);
+	f->text = text;
+	f->len = len;
+	f->owned = 1;
+}
+
+// drop source text (the caller's, or all of it)
+static void forgetfiles(struct a16 *a, unsigned all) {
+	unsigned n;
+	for (n = 0; n < a->file_count; n++) {
+		if (a->files[n].owned && !all)
+			continue;
+		if (a->files[n].owned)
+			free((void*) a->files[n].text);
+		a->files[n].text = 0;
+		a->files[n].owned = 0;
+	}
 }
 
-void save(const char *fn) {
+static void emit(struct a16 *a, unsigned instr) {
+	unsigned rd, wr;
+	regusage(instr, &rd, &wr);
+	a->known_mask &= ~wr;
+	if (((instr & 7) == 6) || ((instr & 0x8E07) == 0x0007)) {
+		// B/BL: the code after a call runs with unknown registers
+		if (instr & 8) a->known_mask = 0;
+	}
+	a->romline[a->PC] = a->linenumber;
+	a->romfile[a->PC] = a->curfile;
+	a->romsect[a->PC] = a->section_count - 1;
+	a->rommovable[a->PC] = a->movable;
+	a->rom[a->PC++] = instr;
+}
+
+static void write_hex(struct a16 *a, FILE *fp) {
 	const char *name;
 	unsigned n;
 	char dis[128];
 
-	FILE *fp = fopen(fn, "w");
-	if (!fp) die("cannot write to '%s'", fn);
-	for (n = 0; n < PC; n++) {
-		disassemble(dis, n, rom[n]);
-		name = getlabel(n);
+	for (n = 0; n < a->PC; n++) {
+		disassemble(dis, n, a->rom[n]);
+		name = getlabel(a, n);
 		if (name) {
-			fprintf(fp, "%04x  // %04x: %-25s <- %s\n", rom[n], n, dis, name);
+			fprintf(fp, "%04x  // %04x: %-25s <- %s\n", a->rom[n], n, dis, name);
 		} else {
-			fprintf(fp, "%04x  // %04x: %s\n", rom[n], n, dis);
+			fprintf(fp, "%04x  // %04x: %s\n", a->rom[n], n, dis);
 		}
 	}
-	fclose(fp);
+}
+
+// raw little-endian 16bit words
+static void write_bin(struct a16 *a, FILE *fp) {
+	unsigned n;
+
+	for (n = 0; n < a->PC; n++) {
+		fputc(a->rom[n] & 0xFF, fp);
+		fputc(a->rom[n] >> 8, fp);
+	}
+}
+
+// intel hex, byte addressed, little-endian words, 16 bytes per record
+// with extended linear address records above 64K
+static void write_ihex(struct a16 *a, FILE *fp) {
+	unsigned n, i, cnt, addr, sum;
+	unsigned upper = 0;
+
+	for (n = 0; n < a->PC; n += 8) {
+		addr = n * 2;
+		if ((addr >> 16) != upper) {
+			upper = addr >> 16;
+			sum = 2 + 4 + (upper >> 8) + (upper & 0xFF);
+			fprintf(fp, ":02000004%04X%02X\n", upper, (-sum) & 0xFF);
+		}
+		cnt = ((a->PC - n) < 8) ? (a->PC - n) : 8;
+		sum = (cnt * 2) + ((addr >> 8) & 0xFF) + (addr & 0xFF);
+		fprintf(fp, ":%02X%04X00", cnt * 2, addr & 0xFFFF);
+		for (i = n; i < (n + cnt); i++) {
+			fprintf(fp, "%02X%02X", a->rom[i] & 0xFF, a->rom[i] >> 8);
+			sum += (a->rom[i] & 0xFF) + (a->rom[i] >> 8);
+		}
+		fprintf(fp, "%02X\n", (-sum) & 0xFF);
+	}
+	fprintf(fp, ":00000001FF\n");
+}
+
+// address, word, disassembly, and source line of every word
+static void write_lst(struct a16 *a, FILE *fp) {
+	const char *name;
+	unsigned n;
+	char dis[128];
+
+	for (n = 0; n < a->PC; n++) {
+		name = getlabel(a, n);
+		if (name) {
+			fprintf(fp, "%s:\n", name);
+		}
+		disassemble(dis, n, a->rom[n]);
+		fprintf(fp, "%04x: %04x  %-25s // %s:%u\n", n, a->rom[n], dis,
+			a->files[a->romfile[n]].name, a->romline[n]);
+	}
+}
+
+// relocatable object for l16, text:
+//   a16obj 1
+//   section <name> <region> <words>   (followed by the words in hex)
+//   global <name> <section> <offset>
+//   local <name> <section> <offset>
+//   extern <name>
+//   reloc <section> <offset> <type> <name>
+// sections are numbered from 0 in file order, offsets are in words
+// from the start of the section, and types are TYPE_* above
+static void write_obj(struct a16 *a, FILE *fp) {
+	struct label *l;
+	struct reloc *r;
+	unsigned n, i;
+
+	fprintf(fp, "a16obj 1\n");
+	for (n = 0; n < a->section_count; n++) {
+		struct section *s = a->sections + n;
+		fprintf(fp, "section %s %s %u\n", s->name, s->region, s->end - s->start);
+		for (i = s->start; i < s->end; i++)
+			fprintf(fp, "%04x%s", a->rom[i],
+				(((i - s->start) % 8) == 7) || (i == (s->end - 1)) ? "\n" : " ");
+	}
+	for (l = a->labels; l; l = l->next) {
+		if (l->defined) {
+			fprintf(fp, "%s %s %u %u\n", l->global ? "global" : "local",
+				l->name, l->section, l->pc - a->sections[l->section].start);
+		} else {
+			fprintf(fp, "extern %s\n", l->name);
+		}
+	}
+	for (r = a->relocs; r; r = r->next) {
+		n = a->romsect[r->pc];
+		fprintf(fp, "reloc %u %u %u %s\n", n, r->pc - a->sections[n].start,
+			r->type, r->label->name);
+	}
+}
+
+static void savefile(struct a16 *a, const char *fn, const char *mode,
+		void (*writer)(struct a16 *a, FILE *fp)) {
+	FILE *fp = fopen(fn, mode);
+	int err;
+	if (!fp) die(a, "cannot write to '%s'", fn);
+	writer(a, fp);
+	err = ferror(fp);
+	if (fclose(fp) || err) die(a, "error writing '%s'", fn);
 }
 
 #define MAXTOKEN 32
@@ -233,11 +708,12 @@ enum tokens {
 	tMOV, tSGE, tSGU, tSNE, tNOP, tHALT,
 	tR0, tR1, tR2, tR3, tR4, tR5, tR6, tR7,
 	tSP, tLR,
-	tEQU, tWORD, tASCII, tASCIIZ,
+	tEQU, tWORD, tASCII, tASCIIZ, tSCRATCH, tLI,
+	tINCLUDE, tMACRO, tENDM, tSECTION, tGLOBAL, tSPACE,
 	NUMTOKENS,
 };
 
-char *tnames[] = {
+static char *tnames[] = {
 	"<EOL>",
 	",", ":", "[", "]", ".", "#", "<STRING>", "<NUMBER>",
 	"AND", "ORR", "XOR", "NOT", "ADD", "SUB", "SLT", "SLU",
@@ -246,33 +722,55 @@ char *tnames[] = {
 	"MOV", "SGE", "SGU", "SNE", "NOP", "HALT",
 	"R0",  "R1",  "R2",  "R3",  "R4",  "R5",  "R6",  "R7",
 	"SP",  "LR",
-	"EQU", "WORD", "STRING", "ASCIIZ"
+	"EQU", "WORD", "STRING", "ASCIIZ", "SCRATCH", "LI",
+	"INCLUDE", "MACRO", "ENDM", "SECTION", "GLOBAL", "SPACE",
 };
 
+// keywords (tNUMBER+1 .. NUMTOKENS-1) hashed by name, open addressing
+static void keywords_init(struct a16 *a) {
+	unsigned n, h;
+	for (n = tNUMBER + 1; n < NUMTOKENS; n++) {
+		h = hashname(tnames[n]) & (KEYWORD_HASH - 1);
+		while (a->keyword_hash[h]) h = (h + 1) & (KEYWORD_HASH - 1);
+		a->keyword_hash[h] = n;
+	}
+}
+
+static unsigned keyword(struct a16 *a, const char *s) {
+	unsigned h = hashname(s) & (KEYWORD_HASH - 1);
+	unsigned n;
+	while ((n = a->keyword_hash[h])) {
+		if (!strcasecmp(s, tnames[n]))
+			return n;
+		h = (h + 1) & (KEYWORD_HASH - 1);
+	}
+	return 0;
+}
+
 #define FIRST_ALU_OP	tAND
 #define LAST_ALU_OP	tMHI
 #define FIRST_REGISTER	tR0
 #define LAST_REGISTER	tLR
 
-int is_reg(unsigned tok) {
+static int is_reg(unsigned tok) {
 	return ((tok >= FIRST_REGISTER) && (tok <= LAST_REGISTER));
 }
 
-int is_alu_op(unsigned tok) {
+static int is_alu_op(unsigned tok) {
 	return ((tok >= FIRST_ALU_OP) && (tok <= LAST_ALU_OP));
 }
 
-unsigned to_func(unsigned tok) {
+static unsigned to_func(unsigned tok) {
 	return tok - FIRST_ALU_OP;
 }
 
-unsigned to_reg(unsigned tok) {
+static unsigned to_reg(unsigned tok) {
 	if (tok == tLR) return 7;
 	if (tok == tSP) return 6;
 	return tok - FIRST_REGISTER;
 }
 
-int is_stopchar(unsigned x) {
+static int is_stopchar(unsigned x) {
 	switch (x) {
 	case 0:
 	case ' ':
@@ -291,7 +789,7 @@ int is_stopchar(unsigned x) {
 		return 0;
 	}
 }	
-int is_eoschar(unsigned x) {
+static int is_eoschar(unsigned x) {
 	switch (x) {
 	case 0:
 	case '\t':
@@ -303,16 +801,15 @@ int is_eoschar(unsigned x) {
 	}
 }
 
-int tokenize(char *line, unsigned *tok, unsigned *num, char **str) {
+static int tokenize(struct a16 *a, char *line, unsigned *tok, unsigned *num, char **str) {
 	char *s;
 	int count = 0;
 	unsigned x, n, neg;
-	linenumber++;
 
 	for (;;) {
 		x = *line;
 	again:
-		if (count == 31) die("line too complex");
+		if (count == 31) die(a, "line too complex");
 
 		switch (x) {
 		case 0:
@@ -370,7 +867,7 @@ int tokenize(char *line, unsigned *tok, unsigned *num, char **str) {
 			tok[count++] = tSTRING;
 			while (!is_eoschar(*line)) line++;
 			if (*line != '"')
-				die("unterminated string");
+				die(a, "unterminated string");
 			*line++ = 0;
 			continue;
 		}
@@ -394,23 +891,21 @@ int tokenize(char *line, unsigned *tok, unsigned *num, char **str) {
 		}
 		if (isalpha(s[0])) {
 			num[count] = 0;
-			for (n = tNUMBER + 1; n < NUMTOKENS; n++) {
-				if (!strcasecmp(s, tnames[n])) {
-					str[count] = tnames[n];
-					tok[count++] = n;
-					goto again;
-				}
+			if ((n = keyword(a, s))) {
+				str[count] = tnames[n];
+				tok[count++] = n;
+				goto again;
 			}
 
 			while (*s) {
 				if (!isalnum(*s) && (*s != '_'))
-					die("invalid character '%c' in identifier", *s);
+					die(a, "invalid character '%c' in identifier", *s);
 				s++;
 			}
 			tok[count++] = tSTRING;
 			goto again;
 		}
-		die("invalid character '%c'", s[0]);
+		die(a, "invalid character '%c'", s[0]);
 	}
 
 alldone:			
@@ -420,14 +915,14 @@ alldone:
 	return count;
 }
 
-void expect(unsigned expected, unsigned got) {
+static void expect(struct a16 *a, unsigned expected, unsigned got) {
 	if (expected != got)
-		die("expected %s, got %s", tnames[expected], tnames[got]);
+		die(a, "expected %s, got %s", tnames[expected], tnames[got]);
 }
 
-void expect_register(unsigned got) {
+static void expect_register(struct a16 *a, unsigned got) {
 	if (!is_reg(got))
-		die("expected register, got %s", tnames[got]);
+		die(a, "expected register, got %s", tnames[got]);
 }
 
 #define REG(n) (tnames[FIRST_REGISTER + (n)])
@@ -469,6 +964,193 @@ void expect_register(unsigned got) {
 #define ALU_SWP 14
 #define ALU_MHI 15
 
+// load a 16bit constant in as few words as possible:
+// - nothing, if Rc already holds it
+// - MOV Rc, si10
+// - ADD Rc, Rk, si7 from a register holding a nearby value
+// - MHI Rc, Rk, hi6 from a register with the same low 10 bits
+// - MOV Rc, lo10 + MHI Rc, Rc, hi6
+static void loadconst(struct a16 *a, unsigned rc, unsigned v) {
+	unsigned sv = (v & 0x8000) ? (v | 0xFFFF0000) : v;
+	unsigned k, d;
+
+	if ((a->known_mask & (1 << rc)) && (a->known_val[rc] == v))
+		return;
+	if (is_signed10(sv)) {
+		emit(a, OP_MOV_RC_S10 | _C(rc) | _I10(sv));
+		goto done;
+	}
+	for (k = 0; k < 8; k++) {
+		if (!(a->known_mask & (1 << k))) continue;
+		d = (v - a->known_val[k]) & 0xFFFF;
+		d = (d & 0x8000) ? (d | 0xFFFF0000) : d;
+		if (is_signed7(d)) {
+			emit(a, OP_ADD_RC_RA_S7 | _C(rc) | _A(k) | _I7(d));
+			goto done;
+		}
+	}
+	for (k = 0; k < 8; k++) {
+		if (!(a->known_mask & (1 << k))) continue;
+		if ((a->known_val[k] & 0x3FF) == (v & 0x3FF)) {
+			emit(a, OP_MHI_RC_RA_S7 | _C(rc) | _A(k) | _I7(v >> 10));
+			goto done;
+		}
+	}
+	emit(a, OP_MOV_RC_S10 | _C(rc) | _I10(sv));
+	emit(a, OP_MHI_RC_RA_S7 | _C(rc) | _A(rc) | _I7(v >> 10));
+done:
+	a->known_mask |= (1 << rc);
+	a->known_val[rc] = v;
+}
+
+// load a label's address into a register and branch through it
+static void longbranch(struct a16 *a, const char *name, int reg, unsigned instr) {
+	if (reg < 0)
+		die(a, "branch to '%s' out of range, set a SCRATCH register", name);
+	emit(a, OP_MOV_RC_S10 | _C(reg));
+	emit(a, OP_MHI_RC_RA_S7 | _C(reg) | _A(reg));
+	uselabel(a, name, a->PC - 2, TYPE_ABS_MOVMHI, -1);
+	emit(a, instr | _A(reg));
+}
+
+static void assemble_line(struct a16 *a, int n, unsigned *tok, unsigned *num, char **str);
+static void assemble(struct a16 *a, const char *fn);
+
+// Macros:
+//   MACRO name
+//   ...          lines, with \1 .. \9 replaced by the arguments and
+//   ...          \@ by a number unique to the expansion (for labels)
+//   ENDM
+// are expanded by "name arg, arg, ...", where each argument is one
+// token (register, number, or name).
+
+#define MAXNESTING 16
+
+struct macro {
+	struct macro *next;
+	char *name;
+	char **line;
+	unsigned count;
+	unsigned max;
+};
+
+static struct macro *findmacro(struct a16 *a, const char *name) {
+	struct macro *m;
+	for (m = a->macros; m; m = m->next)
+		if (!strcasecmp(m->name, name))
+			return m;
+	return 0;
+}
+
+static void newmacro(struct a16 *a, const char *name) {
+	struct macro *m;
+	if (findmacro(a, name)) die(a, "cannot redefine macro '%s'", name);
+	m = calloc(1, sizeof(*m));
+	if (!m) die(a, "out of memory");
+	if (!(m->name = strdup(name))) {
+		free(m);
+		die(a, "out of memory");
+	}
+	m->next = a->macros;
+	a->macros = m;
+	a->defining = m;
+}
+
+static void macroline(struct a16 *a, struct macro *m, const char *line) {
+	if (m->count == m->max) {
+		m->max = m->max ? m->max * 2 : 16;
+		m->line = realloc(m->line, m->max * sizeof(char*));
+		if (!m->line) die(a, "out of memory");
+	}
+	if (!(m->line[m->count] = strdup(line))) die(a, "out of memory");
+	m->count++;
+}
+
+static void resetmacros(struct a16 *a) {
+	struct macro *m;
+	while ((m = a->macros)) {
+		a->macros = m->next;
+		while (m->count > 0)
+			free(m->line[--m->count]);
+		free(m->line);
+		free(m->name);
+		free(m);
+	}
+	a->defining = 0;
+	a->expansions = 0;
+	a->nesting = 0;
+}
+
+static void expandmacro(struct a16 *a, struct macro *m, unsigned *tok, unsigned *num, char **str) {
+	char nbuf[9][16];
+	const char *arg[9];
+	unsigned argc = 0;
+	char line[256], saved[256], id[16];
+	const char *src, *p;
+	char *out;
+	unsigned i, k;
+
+	unsigned t[MAXTOKEN];
+	unsigned nm[MAXTOKEN];
+	char *st[MAXTOKEN];
+	int n;
+
+	for (i = 1; tok[i] != tEOL; i++) {
+		if (argc == 9) die(a, "too many macro arguments");
+		if (tok[i] == tNUMBER) {
+			sprintf(nbuf[argc], "%d", (int) num[i]);
+			arg[argc] = nbuf[argc];
+			argc++;
+		} else {
+			arg[argc++] = str[i];
+		}
+		if (tok[++i] == tEOL) break;
+		expect(a, tCOMMA, tok[i]);
+	}
+
+	if (a->nesting == MAXNESTING) die(a, "macros nested too deeply");
+	a->nesting++;
+	sprintf(id, "%u", a->expansions++);
+	strcpy(saved, a->linestring);
+
+	for (i = 0; i < m->count; i++) {
+		out = line;
+		for (src = m->line[i]; *src; src++) {
+			if ((src[0] == '\\') && (src[1] >= '1') && (src[1] <= '9')) {
+				k = *++src - '1';
+				if (k >= argc) die(a, "macro '%s' needs argument \\%u", m->name, k + 1);
+				p = arg[k];
+			} else if ((src[0] == '\\') && (src[1] == '@')) {
+				src++;
+				p = id;
+			} else {
+				p = 0;
+				if (out == (line + sizeof(line) - 1)) die(a, "macro line too long");
+				*out++ = *src;
+			}
+			while (p && *p) {
+				if (out == (line + sizeof(line) - 1)) die(a, "macro line too long");
+				*out++ = *p++;
+			}
+		}
+		*out = 0;
+		// errors report the expanded line at the invocation's line number
+		strcpy(a->linestring, line);
+		n = tokenize(a, line, t, nm, st);
+		assemble_line(a, n, t, nm, st);
+	}
+
+	strcpy(a->linestring, saved);
+	a->nesting--;
+}
+
+// the first word of a line, if it is kw (for lines not tokenized)
+static int firstword(const char *s, const char *kw) {
+	unsigned n = strlen(kw);
+	while ((*s == ' ') || (*s == '\t')) s++;
+	return !strncasecmp(s, kw, n) && is_stopchar(s[n]);
+}
+
 #define T0 tok[0]
 #define T1 tok[1]
 #define T2 tok[2]
@@ -478,19 +1160,24 @@ void expect_register(unsigned got) {
 #define T6 tok[6]
 #define T7 tok[7]
 
-void assemble_line(int n, unsigned *tok, unsigned *num, char **str) {
+static void assemble_line(struct a16 *a, int n, unsigned *tok, unsigned *num, char **str) {
 	unsigned instr = 0;
 	unsigned tmp;
+	struct macro *m;
+	a->movable = 0;
+	if ((T0 == tSTRING) && (T1 == tCOLON)) {
+		setlabel(a, str[0], a->PC);
+		tok += 2;
+		num += 2;
+		str += 2;
+		n -= 2;
+	}
 	if (T0 == tSTRING) {
-		if (T1 == tCOLON) {
-			setlabel(str[0], PC);
-			tok += 2;
-			num += 2;
-			str += 2;
-			n -= 2;
-		} else {
-			die("unexpected identifier '%s'", str[0]);
+		if ((m = findmacro(a, str[0]))) {
+			expandmacro(a, m, tok, num, str);
+			return;
 		}
+		die(a, "unexpected identifier '%s'", str[0]);
 	}
 
 	switch(T0) {
@@ -498,36 +1185,57 @@ void assemble_line(int n, unsigned *tok, unsigned *num, char **str) {
 		/* blank lines are fine */
 		return;
 	case tNOP:
-		emit(OP_NOP);
+		emit(a, OP_NOP);
 		return;
 	case tNOT:
-		expect_register(T1);
-		expect(tCOMMA, T2);
-		expect_register(T3);
-		emit(OP_ALU_RC_RA_RB | _F(ALU_NOT) | _C(to_reg(T1)) | _A(to_reg(T3)));
+		a->movable = 1;
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
+		expect_register(a, T3);
+		emit(a, OP_ALU_RC_RA_RB | _F(ALU_NOT) | _C(to_reg(T1)) | _A(to_reg(T3)));
 		return;
 	case tMOV:
-		expect_register(T1);
-		expect(tCOMMA, T2);
+		a->movable = 1;
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
 		if (is_reg(T3)) {
-			emit(OP_ALU_RC_RA_RB | _F(ALU_AND) | _C(to_reg(T1)) | _A(to_reg(T3)) | _B(to_reg(T3)));
+			emit(a, OP_ALU_RC_RA_RB | _F(ALU_AND) | _C(to_reg(T1)) | _A(to_reg(T3)) | _B(to_reg(T3)));
 			return;
 		}
-		expect(tNUMBER, T3);
-		emit(OP_MOV_RC_S10 | _C(to_reg(T1)) | _I10(num[3]));
+		expect(a, tNUMBER, T3);
+		emit(a, OP_MOV_RC_S10 | _C(to_reg(T1)) | _I10(num[3]));
 		if (!is_signed10(num[3])) {
 			// load high bits if needed
-			emit(OP_MHI_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T1)) | _I7(num[3] >> 10));
+			emit(a, OP_MHI_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T1)) | _I7(num[3] >> 10));
+		}
+		a->known_mask |= (1 << to_reg(T1));
+		a->known_val[to_reg(T1)] = num[3];
+		return;
+	case tLI:
+		a->movable = 1;
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
+		if (T3 == tSTRING) {
+			// label addresses are not known until later
+			emit(a, OP_MOV_RC_S10 | _C(to_reg(T1)));
+			emit(a, OP_MHI_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T1)));
+			uselabel(a, str[3], a->PC - 2, TYPE_ABS_MOVMHI, -1);
+			return;
 		}
+		expect(a, tNUMBER, T3);
+		if ((num[3] > 0xFFFF) && (num[3] < 0xFFFF8000))
+			die(a, "constant out of range for LI");
+		loadconst(a, to_reg(T1), num[3] & 0xFFFF);
 		return;
 	case tMHI:
-		expect_register(T1);
-		expect(tCOMMA, T2);
+		a->movable = 1;
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
 		if (tok[3] == tNUMBER) {
 			if (num[3] & 0xFFC0) {
-				die("constant out of range for MHI");
+				die(a, "constant out of range for MHI");
 			}
-			emit(OP_MHI_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T1)) | _I7(num[3]));
+			emit(a, OP_MHI_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T1)) | _I7(num[3]));
 			return;
 		}
 		// will be handled by general ALU path
@@ -536,94 +1244,174 @@ void assemble_line(int n, unsigned *tok, unsigned *num, char **str) {
 	case tSHR:
 	case tROL:
 	case tROR:
+		a->movable = 1;
 		switch (T0) {
 		case tSHL: instr = OP_SHL_RC_RA_1; break;
 		case tSHR: instr = OP_SHR_RC_RA_1; break;
 		case tROL: instr = OP_ROL_RC_RA_1; break;
 		case tROR: instr = OP_ROR_RC_RA_1; break;
 		}
-		expect_register(T1);
-		expect(tCOMMA, T2);
-		expect_register(T3);
-		expect(tCOMMA, T4);
-		expect(tNUMBER, T5);	
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
+		expect_register(a, T3);
+		expect(a, tCOMMA, T4);
+		expect(a, tNUMBER, T5);	
 		if (num[5] == 4) {
 			instr |= 0x200;
 		} else if(num[5] != 1) {
-			die("shift/rotate immediate not 1 or 4");
+			die(a, "shift/rotate immediate not 1 or 4");
 		}
-		emit(instr | _C(to_reg(T1)) | _A(to_reg(T3)));
+		emit(a, instr | _C(to_reg(T1)) | _A(to_reg(T3)));
 		return;
 	case tLW:
 	case tSW:
+		a->movable = 1;
 		instr = (T0 == tLW ? OP_LW_RC_RA_S7 : OP_SW_RC_RA_S7);
-		expect_register(T1);
-		expect(tCOMMA, T2);
-		expect(tOBRACK, T3);
-		expect_register(T4);
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
+		expect(a, tOBRACK, T3);
+		expect_register(a, T4);
 		if (T5 == tCOMMA) {
-			expect(tNUMBER, T6);
-			expect(tCBRACK, T7);
+			expect(a, tNUMBER, T6);
+			expect(a, tCBRACK, T7);
 			tmp = num[6];
 		} else {
-			expect(tCBRACK, T5);
+			expect(a, tCBRACK, T5);
 			tmp = 0;
 		}
-		if (!is_signed7(tmp)) die("index too large");
-		emit(instr | _C(to_reg(T1)) | _A(to_reg(T4)) | _I7(tmp));
+		if (!is_signed7(tmp)) die(a, "index too large");
+		emit(a, instr | _C(to_reg(T1)) | _A(to_reg(T4)) | _I7(tmp));
 		return;
 	case tLC:
 	case tSC:
 		instr = (T0 == tLC ? OP_LC_RC_U6 : OP_SC_RC_U6);
-		expect_register(T1);
-		expect(tCOMMA, T2);
-		expect(tNUMBER, T3);
-		if (!is_unsigned6(num[3])) die("invalid control register");
-		emit(instr | _C(to_reg(T1)) | _U6(num[3]));
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
+		expect(a, tNUMBER, T3);
+		if (!is_unsigned6(num[3])) die(a, "invalid control register");
+		emit(a, instr | _C(to_reg(T1)) | _U6(num[3]));
 		return;
 	case tB:
 	case tBL:
 		if (is_reg(T1)) {
 			instr = (T0 == tB) ? OP_B_RA : OP_BL_RA;
-			emit(instr | _A(to_reg(T1)));
+			emit(a, instr | _A(to_reg(T1)));
 		} else {
 			instr = (T0 == tB) ? OP_B_S12 : OP_BL_S12;
 			if (T1 == tSTRING) {
-				emit(instr);
-				uselabel(str[1], PC - 1, TYPE_PCREL_S12);
+				tmp = newsite(a);
+				if (a->site_form[tmp] == 0) {
+					emit(a, instr);
+					uselabel(a, str[1], a->PC - 1, TYPE_PCREL_S12, tmp);
+				} else {
+					longbranch(a, str[1], (T0 == tB) ? a->scratch_reg : 7,
+						(T0 == tB) ? OP_B_RA : OP_BL_RA);
+				}
 			} else if (T1 == tDOT) {
-				emit(instr | _I12(-1));
+				emit(a, instr | _I12(-1));
 			} else {
-				die("expected register or address");
+				die(a, "expected register or address");
 			}
 		}
 		return;
 	case tBZ:
 	case tBNZ:
 		instr = (T0 == tBZ) ? OP_BZ_RC_S9 : OP_BNZ_RC_S9;
-		expect_register(T1);
-		expect(tCOMMA, T2);
+		expect_register(a, T1);
+		expect(a, tCOMMA, T2);
 		if (T3 == tSTRING) {
-			emit(instr | _C(to_reg(T1)));
-			uselabel(str[3], PC - 1, TYPE_PCREL_S9);
+			tmp = newsite(a);
+			if (a->site_form[tmp] == 0) {
+				emit(a, instr | _C(to_reg(T1)));
+				uselabel(a, str[3], a->PC - 1, TYPE_PCREL_S9, tmp);
+				return;
+			}
+			// inverted branch over a longer one
+			instr = (T0 == tBZ) ? OP_BNZ_RC_S9 : OP_BZ_RC_S9;
+			if (a->site_form[tmp] == 1) {
+				emit(a, instr | _C(to_reg(T1)) | _I9(1));
+				emit(a, OP_B_S12);
+				uselabel(a, str[3], a->PC - 1, TYPE_PCREL_S12, tmp);
+			} else {
+				emit(a, instr | _C(to_reg(T1)) | _I9(3));
+				longbranch(a, str[3], a->scratch_reg, OP_B_RA);
+			}
 		} else if (T3 == tDOT) {
-			emit(instr | _C(to_reg(T1)) | _I9(-1));
+			emit(a, instr | _C(to_reg(T1)) | _I9(-1));
 		} else {
-			die("expected register or address");
+			die(a, "expected register or address");
 		}
 		return;
 	case tHALT:
-		emit(0xFFFF); //TODO 
+		emit(a, 0xFFFF); //TODO 
+		return;
+	case tSCRATCH:
+		expect_register(a, T1);
+		a->scratch_reg = to_reg(T1);
+		return;
+	case tINCLUDE: {
+		// relative to the including file
+		char path[1024];
+		const char *dir = strrchr(a->filename, '/');
+		expect(a, tSTRING, T1);
+		if ((str[1][0] == '/') || (dir == 0)) {
+			snprintf(path, sizeof(path), "%s", str[1]);
+		} else {
+			snprintf(path, sizeof(path), "%.*s/%s",
+				(int) (dir - a->filename), a->filename, str[1]);
+		}
+		assemble(a, path);
+		return;
+	}
+	case tMACRO:
+		expect(a, tSTRING, T1);
+		expect(a, tEOL, T2);
+		newmacro(a, str[1]);
+		return;
+	case tENDM:
+		die(a, "ENDM without MACRO");
+	case tSECTION:
+		expect(a, tSTRING, T1);
+		if (T2 == tCOMMA) {
+			expect(a, tSTRING, T3);
+			newsection(a, str[1], str[3]);
+		} else {
+			expect(a, tEOL, T2);
+			newsection(a, str[1], "code");
+		}
+		// may be entered from anywhere once placed
+		a->known_mask = 0;
+		return;
+	case tGLOBAL:
+		tmp = 1;
+		for (;;) {
+			struct label *l;
+			unsigned hash;
+			expect(a, tSTRING, tok[tmp]);
+			hash = hashname(str[tmp]);
+			if (!(l = findlabel(a, str[tmp], hash)))
+				l = newlabel(a, str[tmp], hash);
+			l->global = 1;
+			if (tok[++tmp] != tCOMMA)
+				break;
+			tmp++;
+		}
+		return;
+	case tSPACE:
+		expect(a, tNUMBER, T1);
+		if (num[1] > (0xFFFF - a->PC)) die(a, "SPACE too large");
+		for (tmp = 0; tmp < num[1]; tmp++)
+			emit(a, 0);
 		return;
 	case tWORD:
 		tmp = 1;
 		for (;;) {
 			if (tok[tmp] == tSTRING) {
-				emit(0);
-				uselabel(str[tmp++], PC - 1, TYPE_ABS_U16);
+				emit(a, 0);
+				uselabel(a, str[tmp++], a->PC - 1, TYPE_ABS_U16, -1);
 			} else {
-				expect(tNUMBER, tok[tmp]);
-				emit(num[tmp++]);
+				expect(a, tNUMBER, tok[tmp]);
+				emit(a, num[tmp++]);
 			}
 			if (tok[tmp] != tCOMMA)
 				break;
@@ -634,43 +1422,46 @@ void assemble_line(int n, unsigned *tok, unsigned *num, char **str) {
 	case tASCIIZ: {
 		unsigned n = 0, c = 0; 
 		const unsigned char *s = (void*) str[1];
-		expect(tSTRING, tok[1]);
+		expect(a, tSTRING, tok[1]);
 		while (*s) {
 			n |= ((*s) << (c++ * 8));
 			if (c == 2) {
-				emit(n);
+				emit(a, n);
 				n = 0;
 				c = 0;
 			}
 			s++;
 		}
-		emit(n);
+		emit(a, n);
 		return;
 	}
 	}
 	if (is_alu_op(T0)) {
-		expect_register(T1);
-		expect(T2, tCOMMA);
-		expect_register(T3);
-		expect(T4, tCOMMA);
+		a->movable = 1;
+		expect_register(a, T1);
+		expect(a, T2, tCOMMA);
+		expect_register(a, T3);
+		expect(a, T4, tCOMMA);
 		if ((tok[5] == tNUMBER) && (T0 == tADD)) {
 			if (!is_signed7(num[5])) {
-				die("add immediate must be +/-128");
+				die(a, "add immediate must be +/-128");
 			}
-			emit(OP_ADD_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T3)) | _I7(num[5]));
+			emit(a, OP_ADD_RC_RA_S7 | _C(to_reg(T1)) | _A(to_reg(T3)) | _I7(num[5]));
 			return;
 		}
-		expect_register(T5);
-		emit(OP_ALU_RC_RA_RB | _C(to_reg(T1)) | _A(to_reg(T3)) | _B(to_reg(T5)) | _F(to_func(T0)));
+		expect_register(a, T5);
+		emit(a, OP_ALU_RC_RA_RB | _C(to_reg(T1)) | _A(to_reg(T3)) | _B(to_reg(T5)) | _F(to_func(T0)));
 		return;
 	}
 
-	die("HUH");
+	die(a, "HUH");
 }
 
-void assemble(const char *fn) {
-	FILE *fp;
+static void assemble_source(struct a16 *a, unsigned file) {
+	const char *src = a->files[file].text;
+	const char *end = src + a->files[file].len;
 	char line[256];
+	unsigned len;
 	int n;
 
 	unsigned tok[MAXTOKEN];
@@ -678,43 +1469,491 @@ void assemble(const char *fn) {
 	char *str[MAXTOKEN];
 	char *s;
 
-	fp = fopen(fn, "r");
-	if (!fp) die("cannot open '%s'", fn);
+	// includes return to the including file's line
+	const char *oldname = a->filename;
+	unsigned oldline = a->linenumber;
+	unsigned oldfile = a->curfile;
+
+	if (a->nesting == MAXNESTING) die(a, "includes nested too deeply");
+	a->nesting++;
+	a->curfile = file;
+	a->filename = a->files[file].name;
+	a->linenumber = 0;
 
-	while (fgets(line, sizeof(line)-1, fp)) {
-		strcpy(linestring, line);
-		s = linestring;
+	while (src < end) {
+		// a line, or as much as fits
+		len = 0;
+		while ((src < end) && (len < (sizeof(line) - 2)))
+			if ((line[len++] = *src++) == '\n')
+				break;
+		line[len] = 0;
+
+		a->linenumber++;
+		strcpy(a->linestring, line);
+		s = a->linestring;
 		while (*s) {
 			if ((*s == '\r') || (*s == '\n')) *s = 0;
 			else s++;
 		}
-		n = tokenize(line, tok, num, str);
+		if (a->defining) {
+			// macro bodies are kept as text until expanded
+			if (firstword(a->linestring, "ENDM")) {
+				a->defining = 0;
+			} else if (firstword(a->linestring, "MACRO")) {
+				die(a, "MACRO inside MACRO");
+			} else {
+				macroline(a, a->defining, a->linestring);
+			}
+			continue;
+		}
+		n = tokenize(a, line, tok, num, str);
 #if DEBUG
 		{
 			int i
-			printf("%04d: (%02d)  ", linenumber, n);
+			printf("%04d: (%02d)  ", a->linenumber, n);
 			for (i = 0; i < n; i++)
 				printf("%s ", tnames[tok[i]]);
 			printf("\n");
 		}
 #endif
-		assemble_line(n, tok, num, str);
+		assemble_line(a, n, tok, num, str);
 	}
+	if (a->defining) die(a, "MACRO '%s' without ENDM", a->defining->name);
+
+	a->nesting--;
+	a->filename = oldname;
+	a->linenumber = oldline;
+	a->curfile = oldfile;
+}
+
+static void assemble(struct a16 *a, const char *fn) {
+	unsigned n = addfile(a, fn);
+	if (!a->files[n].text)
+		loadfile(a, a->files + n);
+	assemble_source(a, n);
+}
+
+// ---- instruction scheduler (-sched) ----
+//
+// cpu16 does not forward results: an instruction in decode waits
+// while an instruction in execute or writeback is writing a register
+// it reads, so a dependent instruction d slots after its producer
+// (d = 1 is adjacent) stalls 3 - d cycles.  The scheduler reorders
+// each basic block (a run of movable words in one section, split at
+// labels) with a list scheduler that places the ready instruction
+// with the fewest stalls first, keeping register and memory
+// dependencies in order.
+
+#define SCHED_MAX 64
+
+// stall cycles before an instruction reading rd, given the registers
+// written by the previous two instructions
+static unsigned stalls(unsigned rd, unsigned wr1, unsigned wr2) {
+	if (rd & wr1) return 2;
+	if (rd & wr2) return 1;
+	return 0;
+}
+
+static void schedule_block(struct a16 *a, unsigned s, unsigned e) {
+	unsigned n = e - s;
+	unsigned rd[SCHED_MAX], wr[SCHED_MAX], mem[SCHED_MAX];
+	unsigned height[SCHED_MAX], order[SCHED_MAX];
+	uint64_t dep[SCHED_MAX];
+	uint64_t done = 0;
+	u16 ins[SCHED_MAX];
+	unsigned line[SCHED_MAX];
+	unsigned char file[SCHED_MAX];
+	unsigned i, j, k, pick, first = 0, best, cost;
+	unsigned before = 0, after = 0, moved = 0;
+	unsigned wr1 = 0, wr2 = 0, t;
+
+	// hazards from the two words before the block
+	if (s > 0) regusage(a->rom[s - 1], &t, &wr1);
+	if (s > 1) regusage(a->rom[s - 2], &t, &wr2);
+
+	for (i = 0; i < n; i++) {
+		regusage(a->rom[s + i], &rd[i], &wr[i]);
+		// loads and stores stay in order: any of them may be i/o
+		mem[i] = ((a->rom[s + i] & 7) == 3) || ((a->rom[s + i] & 7) == 5);
+		dep[i] = 0;
+		for (j = 0; j < i; j++) {
+			if ((rd[i] & wr[j]) || (wr[i] & rd[j]) || (wr[i] & wr[j]) ||
+				(mem[i] && mem[j]))
+				dep[i] |= 1ULL << j;
+		}
+	}
+	for (i = n; i-- > 0; ) {
+		height[i] = 1;
+		for (j = i + 1; j < n; j++)
+			if ((dep[j] & (1ULL << i)) && (height[j] + 1 > height[i]))
+				height[i] = height[j] + 1;
+	}
+
+	// original cost
+	{
+		unsigned w1 = wr1, w2 = wr2;
+		for (i = 0; i < n; i++) {
+			before += stalls(rd[i], w1, w2);
+			w2 = w1;
+			w1 = wr[i];
+		}
+	}
+
+	// the next instruction in program order is placed unless another
+	// ready one stalls less
+	for (k = 0; k < n; k++) {
+		pick = n;
+		best = 0;
+		for (i = 0; i < n; i++) {
+			if ((done & (1ULL << i)) || ((dep[i] & done) != dep[i]))
+				continue;
+			cost = stalls(rd[i], wr1, wr2);
+			if ((pick == n) || (cost < best) ||
+				((cost == best) && (pick != first) && (height[i] > height[pick]))) {
+				if (pick == n) first = i;
+				pick = i;
+				best = cost;
+			}
+		}
+		order[k] = pick;
+		done |= 1ULL << pick;
+		after += best;
+		if (pick != k) moved++;
+		wr2 = wr1;
+		wr1 = wr[pick];
+	}
+
+	a->sched.stalls_before += before;
+	if (after >= before) {
+		// no better, leave it alone
+		a->sched.stalls_after += before;
+		return;
+	}
+	a->sched.stalls_after += after;
+	a->sched.moved += moved;
+
+	for (i = 0; i < n; i++) {
+		ins[i] = a->rom[s + order[i]];
+		line[i] = a->romline[s + order[i]];
+		file[i] = a->romfile[s + order[i]];
+	}
+	for (i = 0; i < n; i++) {
+		a->rom[s + i] = ins[i];
+		a->romline[s + i] = line[i];
+		a->romfile[s + i] = file[i];
+	}
+}
+
+static void schedule(struct a16 *a) {
+	unsigned pc = 0, end, blocks = 0;
+	memset(&a->sched, 0, sizeof(a->sched));
+	while (pc < a->PC) {
+		if (!a->rommovable[pc]) {
+			pc++;
+			continue;
+		}
+		end = pc + 1;
+		while ((end < a->PC) && a->rommovable[end] && !a->label_at[end] &&
+			(a->romsect[end] == a->romsect[pc]) && ((end - pc) < SCHED_MAX))
+			end++;
+		if ((end - pc) > 1) {
+			schedule_block(a, pc, end);
+			blocks++;
+		}
+		pc = end;
+	}
+	a->sched.blocks = blocks;
+}
+
+// ---- library interface (a16.h) ----
+
+static void keywords_init(struct a16 *a);
+
+struct a16 *a16_new(unsigned flags) {
+	struct a16 *a = calloc(1, sizeof(*a));
+	if (!a) return 0;
+	if (!(a->sections = calloc(MAXSECTIONS, sizeof(struct section)))) {
+		free(a);
+		return 0;
+	}
+	a->flags = flags;
+	a->objmode = (flags & A16_OBJ) ? 1 : 0;
+	a->filename = "";
+	a->scratch_reg = -1;
+	keywords_init(a);
+	return a;
+}
+
+// forget the previous program, keeping allocations that can be reused
+static void reset(struct a16 *a) {
+	struct label *l;
+	unsigned n;
+
+	resetlabels(a);
+	resetmacros(a);
+	while ((l = a->labels)) {
+		a->labels = l->next;
+		a->label_hash[l->hash & (a->label_hash_size - 1)] = 0;
+		free((void*) l->name);
+		free(l);
+	}
+	a->label_count = 0;
+	if (a->site_form)
+		memset(a->site_form, 0, a->site_max);
+	forgetfiles(a, 1);
+	for (n = 0; n < a->file_count; n++)
+		free(a->files[n].name);
+	a->file_count = 0;
+	a->curfile = 0;
+	a->PC = 0;
+	a->linenumber = 0;
+	a->linestring[0] = 0;
+	memset(&a->sched, 0, sizeof(a->sched));
+}
+
+void a16_free(struct a16 *a) {
+	if (!a) return;
+	reset(a);
+	while (a->section_count > 0) {
+		a->section_count--;
+		free(a->sections[a->section_count].name);
+		free(a->sections[a->section_count].region);
+	}
+	free(a->sections);
+	free(a->label_hash);
+	free(a->site_form);
+	free(a);
+}
+
+const char *a16_error(struct a16 *a) {
+	return a->error;
+}
+
+// assemble until no branch needed a longer form
+static void passes(struct a16 *a, unsigned file) {
+	do {
+		a->PC = 0;
+		a->linenumber = 0;
+		a->site_count = 0;
+		a->scratch_reg = -1;
+		a->known_mask = 0;
+		a->relax = 0;
+		resetlabels(a);
+		resetsections(a);
+		resetmacros(a);
+		assemble_source(a, file);
+	} while (a->relax);
+	a->sections[a->section_count - 1].end = a->PC;
+	a->linestring[0] = 0;
+	checklabels(a);
+}
+
+int a16_assemble(struct a16 *a, const char *name, const char *text, unsigned len) {
+	unsigned n;
+	if (setjmp(a->jmp)) {
+		forgetfiles(a, 0);
+		return -1;
+	}
+	reset(a);
+	a->filename = name;
+	n = addfile(a, name);
+	a->files[n].text = text;
+	a->files[n].len = len;
+	passes(a, n);
+	forgetfiles(a, 0);
+	return 0;
+}
+
+int a16_assemble_file(struct a16 *a, const char *fn) {
+	unsigned n;
+	if (setjmp(a->jmp))
+		return -1;
+	reset(a);
+	a->filename = fn;
+	n = addfile(a, fn);
+	loadfile(a, a->files + n);
+	passes(a, n);
+	return 0;
+}
+
+const uint16_t *a16_words(struct a16 *a, unsigned *count) {
+	*count = a->PC;
+	return a->rom;
+}
+
+void a16_schedule(struct a16 *a, struct a16_sched_stats *stats) {
+	schedule(a);
+	if (stats) *stats = a->sched;
+}
+
+int a16_save_hex(struct a16 *a, const char *fn) {
+	if (setjmp(a->jmp)) return -1;
+	savefile(a, fn, "w", write_hex);
+	return 0;
+}
+
+int a16_save_bin(struct a16 *a, const char *fn) {
+	if (setjmp(a->jmp)) return -1;
+	savefile(a, fn, "wb", write_bin);
+	return 0;
+}
+
+int a16_save_ihex(struct a16 *a, const char *fn) {
+	if (setjmp(a->jmp)) return -1;
+	savefile(a, fn, "w", write_ihex);
+	return 0;
+}
+
+int a16_save_lst(struct a16 *a, const char *fn) {
+	if (setjmp(a->jmp)) return -1;
+	savefile(a, fn, "w", write_lst);
+	return 0;
+}
+
+int a16_save_obj(struct a16 *a, const char *fn) {
+	if (setjmp(a->jmp)) return -1;
+	savefile(a, fn, "w", write_obj);
+	return 0;
+}
+
+int a16_write_hex(struct a16 *a, FILE *fp) {
+	if (setjmp(a->jmp)) return -1;
+	write_hex(a, fp);
+	if (ferror(fp)) die(a, "write error");
+	return 0;
+}
+
+int a16_write_bin(struct a16 *a, FILE *fp) {
+	if (setjmp(a->jmp)) return -1;
+	write_bin(a, fp);
+	if (ferror(fp)) die(a, "write error");
+	return 0;
+}
+
+int a16_write_ihex(struct a16 *a, FILE *fp) {
+	if (setjmp(a->jmp)) return -1;
+	write_ihex(a, fp);
+	if (ferror(fp)) die(a, "write error");
+	return 0;
+}
+
+int a16_write_lst(struct a16 *a, FILE *fp) {
+	if (setjmp(a->jmp)) return -1;
+	write_lst(a, fp);
+	if (ferror(fp)) die(a, "write error");
+	return 0;
+}
+
+int a16_write_obj(struct a16 *a, FILE *fp) {
+	if (setjmp(a->jmp)) return -1;
+	write_obj(a, fp);
+	if (ferror(fp)) die(a, "write error");
+	return 0;
+}
+
+#ifndef A16_LIBRARY
+static void usage(void) {
+	fprintf(stderr,
+		"usage:   a16 [ <option> ]* <source> [ <hexfile> ]\n"
+		"\n"
+		"option:  -hex <file>    hex words with disassembly (default out.hex)\n"
+		"         -bin <file>    raw little-endian words\n"
+		"         -ihex <file>   intel hex (byte addresses)\n"
+		"         -lst <file>    listing with source line numbers\n"
+		"         -obj <file>    relocatable object for l16 (no image)\n"
+		"         -sched         reorder instructions to avoid stalls\n"
+		);
+	exit(1);
 }
 
 int main(int argc, char **argv) {
-	const char *outname = "out.hex";
-	filename = argv[1];
+	const char *filename = 0;
+	const char *hexname = 0;
+	const char *binname = 0;
+	const char *ihexname = 0;
+	const char *lstname = 0;
+	const char *objname = 0;
+	struct a16_sched_stats st;
+	struct a16 *a;
+	int n = 0;
+	int sched = 0;
 
-	if (argc < 2)
-		die("no file specified");
-	if (argc == 3)
-		outname = argv[2];
+	argc--;
+	argv++;
+	while (argc > 0) {
+		if (!strcmp(argv[0], "-sched")) {
+			sched = 1;
+			argc--;
+			argv++;
+			continue;
+		}
+		if (argv[0][0] == '-') {
+			if (argc < 2) usage();
+			if (!strcmp(argv[0], "-hex")) {
+				hexname = argv[1];
+			} else if (!strcmp(argv[0], "-bin")) {
+				binname = argv[1];
+			} else if (!strcmp(argv[0], "-ihex")) {
+				ihexname = argv[1];
+			} else if (!strcmp(argv[0], "-lst")) {
+				lstname = argv[1];
+			} else if (!strcmp(argv[0], "-obj")) {
+				objname = argv[1];
+			} else {
+				usage();
+			}
+			argc -= 2;
+			argv += 2;
+			continue;
+		}
+		if (n == 0) {
+			filename = argv[0];
+		} else if (n == 1) {
+			hexname = argv[0];
+		} else {
+			usage();
+		}
+		n++;
+		argc--;
+		argv++;
+	}
 
-	assemble(filename);
-	linestring[0] = 0;
-	checklabels();
-	save(outname);
+	if (filename == 0) {
+		fprintf(stderr, "a16: no file specified\n");
+		return 1;
+	}
+	if (objname && (hexname || binname || ihexname)) {
+		fprintf(stderr, "a16: -obj has no image, link it with l16\n");
+		return 1;
+	}
+	if (!hexname && !binname && !ihexname && !lstname && !objname)
+		hexname = "out.hex";
 
+	if (!(a = a16_new(objname ? A16_OBJ : 0))) {
+		fprintf(stderr, "a16: out of memory\n");
+		return 1;
+	}
+	if (a16_assemble_file(a, filename))
+		goto fail;
+	if (sched) {
+		a16_schedule(a, &st);
+		fprintf(stderr, "a16: sched: %u blocks, %u instructions moved, "
+			"est. stalls %u -> %u (%u cycles saved)\n",
+			st.blocks, st.moved, st.stalls_before, st.stalls_after,
+			st.stalls_before - st.stalls_after);
+	}
+	if ((hexname && a16_save_hex(a, hexname)) ||
+		(binname && a16_save_bin(a, binname)) ||
+		(ihexname && a16_save_ihex(a, ihexname)) ||
+		(lstname && a16_save_lst(a, lstname)) ||
+		(objname && a16_save_obj(a, objname)))
+		goto fail;
+	a16_free(a);
 	return 0;
+
+fail:
+	fprintf(stderr, "%s\n", a16_error(a));
+	a16_free(a);
+	return 1;
 }
+#endif
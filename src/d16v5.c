@@ -7,34 +7,34 @@
 #include <ctype.h>
 #include <strings.h>
 #include <string.h>
+#include <stdint.h>
+
+#include "a16.h"
 
 typedef unsigned u32;
 typedef unsigned short u16;
+typedef unsigned char u8;
 
-char *append(char *buf, const char *s) {
+static char *append(char *buf, const char *s) {
 	while (*s)
 		*buf++ = *s++;
 	return buf;
 }
-char *append_u16(char *buf, unsigned n) {
+static char *append_u16(char *buf, unsigned n) {
 	sprintf(buf, "%04x", n & 0xFFFF);
 	return buf + strlen(buf);
 }
-char *append_int(char *buf, int n) {
-	sprintf(buf, "%d", n);
-	return buf + strlen(buf);
-}
 
-const char *regname[] = {
+static const char *regname[] = {
 	"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
 };
 
-const char *alufunc[] = {
+static const char *alufunc[] = {
 	"AND", "ORR", "XOR", "NOT", "ADD", "SUB", "SLT", "SLU",
 	"SHL", "SHR", "ROL", "ROR", "MUL", "DUP", "SWP", "MHI",
 };
 
-void printinst(char *buf, unsigned pc, unsigned instr, const char *fmt, unsigned verbose) {
+static void printinst(char *buf, unsigned pc, unsigned instr, const char *fmt, unsigned verbose) {
 	char *start = buf;
 	char note[64];
 	note[0] = 0;
@@ -114,7 +114,7 @@ done:
 	*buf = 0;
 }
 
-struct {
+static const struct {
 	u16 mask;
 	u16 value;
 	const char *fmt;
@@ -171,18 +171,278 @@ void disassemble(char *buf, unsigned pc, unsigned instr) {
 	disassemble0(buf, pc, instr, 1);
 }
 
+// ---- bulk disassembly ----
+//
+// The text of every possible instruction word is formatted once into
+// a 64K entry table.  Pc-relative branches keep the text up to the
+// target, which is appended (with its symbol) per word, so a buffer
+// is disassembled with copies and no printf.
+
+struct d16_entry {
+	short disp;      // branch target is pc + 1 + disp
+	u8 pcrel;
+	u8 len;
+	char text[28];
+};
+
+static struct d16_entry *d16_table;
+
+static const char hexdigit[] = "0123456789abcdef";
+
+static char *append_hex4(char *buf, unsigned n) {
+	buf[0] = hexdigit[(n >> 12) & 15];
+	buf[1] = hexdigit[(n >> 8) & 15];
+	buf[2] = hexdigit[(n >> 4) & 15];
+	buf[3] = hexdigit[n & 15];
+	return buf + 4;
+}
+
+int d16_init(void) {
+	struct d16_entry *e;
+	char fmt[32], *x;
+	unsigned w, n;
+	int disp;
+
+	if (d16_table) return 0;
+	if (!(e = malloc(65536 * sizeof(*e)))) return -1;
+	for (w = 0; w < 65536; w++) {
+		for (n = 0; (w & decode[n].mask) != decode[n].value; n++) ;
+		strcpy(fmt, decode[n].fmt);
+		e[w].pcrel = 0;
+		e[w].disp = 0;
+		// branch targets are always last
+		if ((x = strstr(fmt, "@9")) || (x = strstr(fmt, "@2"))) {
+			disp = ((w >> 9) & 0x3F) | (w & 0x1C0);
+			if (x[1] == '9') {
+				disp &= 0xFF;
+				if (w & 0x8000) disp |= 0xFFFFFF00;
+			} else {
+				disp |= (w & 0x30) << 5;
+				if (w & 0x8000) disp |= 0xFFFFF800;
+			}
+			e[w].pcrel = 1;
+			e[w].disp = disp;
+			*x = 0;
+		}
+		printinst(e[w].text, 0, w, fmt, 0);
+		e[w].len = strlen(e[w].text);
+	}
+	d16_table = e;
+	return 0;
+}
+
+// symbols, by address
+
+struct d16_symbols {
+	char *name[65536];
+};
+
+static int addsym(struct d16_symbols *syms, unsigned addr, const char *name) {
+	char *s;
+	if (addr > 0xFFFF) return 0;
+	if (!(s = malloc(D16_SYMBOL_MAX + 1))) return -1;
+	snprintf(s, D16_SYMBOL_MAX + 1, "%s", name);
+	free(syms->name[addr]);
+	syms->name[addr] = s;
+	return 0;
+}
+
+// from an a16 listing ("name:" before the labelled word) or l16 map
+// ("symbol addr name")
+struct d16_symbols *d16_symbols_load(const char *fn) {
+	struct d16_symbols *syms;
+	char line[1024], name[1024];
+	unsigned addr, len;
+	FILE *fp;
+
+	if (!(fp = fopen(fn, "r"))) return 0;
+	if (!(syms = calloc(1, sizeof(*syms)))) goto fail;
+	name[0] = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		len = strlen(line);
+		while ((len > 0) && isspace(line[len - 1])) line[--len] = 0;
+		if ((len > 1) && (line[len - 1] == ':') && !isspace(line[0])) {
+			// label, the address is on the next line
+			line[len - 1] = 0;
+			strcpy(name, line);
+		} else if (sscanf(line, "%x:", &addr) == 1) {
+			if (name[0] && addsym(syms, addr, name)) goto fail;
+			name[0] = 0;
+		} else if (sscanf(line, "symbol %x %1023s", &addr, name) == 2) {
+			if (addsym(syms, addr, name)) goto fail;
+			name[0] = 0;
+		}
+	}
+	fclose(fp);
+	return syms;
+fail:
+	fclose(fp);
+	d16_symbols_free(syms);
+	return 0;
+}
+
+void d16_symbols_free(struct d16_symbols *syms) {
+	unsigned n;
+	if (!syms) return;
+	for (n = 0; n < 65536; n++)
+		free(syms->name[n]);
+	free(syms);
+}
+
+const char *d16_symbol(struct d16_symbols *syms, unsigned addr) {
+	return syms ? syms->name[addr & 0xFFFF] : 0;
+}
+
+static char *append_name(char *buf, const char *s) {
+	while (*s)
+		*buf++ = *s++;
+	return buf;
+}
+
+size_t d16_disassemble_words(char *out, const uint16_t *words, unsigned count,
+		unsigned pc, struct d16_symbols *syms) {
+	const struct d16_entry *e;
+	const char *name;
+	char *buf = out;
+	unsigned n, target;
+
+	if (d16_init()) return 0;
+	for (n = 0; n < count; n++, pc++) {
+		e = d16_table + words[n];
+		if (syms && (name = syms->name[pc & 0xFFFF])) {
+			buf = append_name(buf, name);
+			*buf++ = ':';
+			*buf++ = '\n';
+		}
+		buf = append_hex4(buf, pc);
+		*buf++ = ':';
+		*buf++ = ' ';
+		buf = append_hex4(buf, words[n]);
+		*buf++ = ' ';
+		*buf++ = ' ';
+		memcpy(buf, e->text, e->len);
+		buf += e->len;
+		if (e->pcrel) {
+			target = (pc + 1 + e->disp) & 0xFFFF;
+			buf = append_hex4(buf, target);
+			if (syms && (name = syms->name[target])) {
+				*buf++ = ' ';
+				*buf++ = '<';
+				buf = append_name(buf, name);
+				*buf++ = '>';
+			}
+		}
+		*buf++ = '\n';
+	}
+	return buf - out;
+}
+
 #ifdef STANDALONE
+// a16 -bin (16bit words) or testbench -dump (32bit words) image
+static uint16_t *loadimage(const char *fn, unsigned wordsize, unsigned *count) {
+	static uint16_t words[65536];
+	unsigned char buf[4];
+	unsigned n = 0;
+	FILE *fp = fopen(fn, "rb");
+	if (!fp) return 0;
+	while ((n < 65536) && (fread(buf, wordsize, 1, fp) == 1))
+		words[n++] = buf[0] | (buf[1] << 8);
+	fclose(fp);
+	*count = n;
+	return words;
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage:   d16                   disassemble \"<insn><pc>\" hex lines from stdin\n"
+		"         d16 [ <option> ]* -bin <file>\n"
+		"         d16 [ <option> ]* -dump <file>\n"
+		"\n"
+		"  -bin <file>     a16 -bin image (little-endian 16bit words)\n"
+		"  -dump <file>    testbench -dump image (32bit words)\n"
+		"option:  -sym <file>     symbols from an a16 -lst listing or l16 -map\n"
+		"         -o <file>       output file (default stdout)\n"
+		"         -base <addr>    address of the first word (default 0)\n"
+		);
+	exit(1);
+}
+
+// words per chunk, sized so a chunk always fits the output buffer
+#define CHUNK 4096
+
 int main(int argc, char **argv) {
-        char buf[256];
-        char line[1024];
-        while (fgets(line, 1024, stdin)) {
-                unsigned insn = 0xFFFF;
-		unsigned pc = 0;
-                sscanf(line, "%04x%04x", &insn, &pc);
-                disassemble0(buf, pc, insn, 0);
-                printf("%s\n", buf);
-                fflush(stdout);
-        }
-        return 0;
+	const char *imgname = 0;
+	const char *symname = 0;
+	const char *outname = 0;
+	struct d16_symbols *syms = 0;
+	unsigned wordsize = 2;
+	unsigned base = 0;
+	unsigned count, n, len;
+	uint16_t *words;
+	static char out[CHUNK * D16_LINE_MAX];
+	FILE *fp = stdout;
+
+	argc--;
+	argv++;
+	while (argc > 0) {
+		if (argc < 2) usage();
+		if (!strcmp(argv[0], "-bin")) {
+			imgname = argv[1];
+			wordsize = 2;
+		} else if (!strcmp(argv[0], "-dump")) {
+			imgname = argv[1];
+			wordsize = 4;
+		} else if (!strcmp(argv[0], "-sym")) {
+			symname = argv[1];
+		} else if (!strcmp(argv[0], "-o")) {
+			outname = argv[1];
+		} else if (!strcmp(argv[0], "-base")) {
+			base = strtoul(argv[1], 0, 0);
+		} else {
+			usage();
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (imgname == 0) {
+		// filter mode (eg, for gtkwave)
+		char buf[256];
+		char line[1024];
+		while (fgets(line, 1024, stdin)) {
+			unsigned insn = 0xFFFF;
+			unsigned pc = 0;
+			sscanf(line, "%04x%04x", &insn, &pc);
+			disassemble0(buf, pc, insn, 0);
+			printf("%s\n", buf);
+			fflush(stdout);
+		}
+		return 0;
+	}
+
+	if (symname && !(syms = d16_symbols_load(symname))) {
+		fprintf(stderr, "d16: cannot load symbols from '%s'\n", symname);
+		return 1;
+	}
+	if (!(words = loadimage(imgname, wordsize, &count))) {
+		fprintf(stderr, "d16: cannot read '%s'\n", imgname);
+		return 1;
+	}
+	if (outname && !(fp = fopen(outname, "w"))) {
+		fprintf(stderr, "d16: cannot write to '%s'\n", outname);
+		return 1;
+	}
+	for (n = 0; n < count; n += CHUNK) {
+		len = d16_disassemble_words(out, words + n,
+			((count - n) < CHUNK) ? (count - n) : CHUNK, base + n, syms);
+		if (fwrite(out, 1, len, fp) != len) {
+			fprintf(stderr, "d16: write error\n");
+			return 1;
+		}
+	}
+	if (fp != stdout)
+		fclose(fp);
+	d16_symbols_free(syms);
+	return 0;
 }
 #endif
@@ -64,9 +64,15 @@ int spi_tx(FTDI *d, void *data, int len) {
 	return 0;
 }
 
+// raw little-endian 16bit words (a16 -bin) vs hex text
+static int is_bin(const char *fn) {
+	size_t len = strlen(fn);
+	return (len > 4) && !strcmp(fn + len - 4, ".bin");
+}
+
 void usage(void) {
 	fprintf(stderr, 
-	"usage:   icetool -load <addr> <hexfile>\n"
+	"usage:   icetool -load <addr> <hexfile>|<binfile>\n"
 	"         icetool -write <addr> <value>...\n"
 	);
 	exit(1);
@@ -97,7 +103,13 @@ int main(int argc, char **argv) {
 			return 1;
 		}
 		n = 0;
-		while (fgets(buf, 1024, fp)) {
+		if (is_bin(argv[3])) {
+			unsigned char w[2];
+			while (fread(w, 2, 1, fp) == 1) {
+				if (n == 2048) return 1;
+				data[1 + n++] = w[0] | (w[1] << 8);
+			}
+		} else while (fgets(buf, 1024, fp)) {
 			if (!isalnum(buf[0])) continue;
 			if (n == 2048) return 1;
 			data[1 + n++] = strtoul(buf, 0, 16);
@@ -0,0 +1,503 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// l16: links a16 objects (a16 -obj) into a cpu16 image
+//
+// Sections are placed by region, in command line and then source
+// order.  Each region starts at its base, or where the region it
+// follows ends.  Sections in regions that are not loaded (vram, io)
+// get addresses but no words in the image, so they should only hold
+// SPACE.  With -gc, sections not reachable through relocations from
+// the first section of the first object (the entry point) or from a
+// -keep symbol are dropped.  Sections are moved and dropped whole,
+// so code must not fall through from one section into the next.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <strings.h>
+#include <string.h>
+
+#include "a16.h"
+
+typedef unsigned short u16;
+
+void die(const char *fmt, ...) {
+	va_list ap;
+	fprintf(stderr,"l16: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr,"\n");
+	exit(1);
+}
+
+// relocation types, as a16
+#define TYPE_PCREL_S9	1
+#define TYPE_PCREL_S12	2
+#define TYPE_ABS_U16	3
+#define TYPE_ABS_MOVMHI	4	// MOV Rx, lo10 + MHI Rx, Rx, hi6
+
+#define _I7(n)          (((n) & 0x7F) << 9)
+
+// instr: siiiiii-jj------
+// imm           sjjiiiiii
+static inline unsigned _I9(unsigned n) {
+	return ((n & 0x3F) << 9) | (n & 0xC0) | ((n & 0x100) << 7);
+}
+
+// instr: siiiiiijjj------
+// imm          sjjjiiiiii
+static inline unsigned _I10(unsigned n) {
+	return ((n & 0x3F) << 9) | (n & 0x1C0) | ((n & 0x200) << 6);
+}
+
+// instr: siiiiiijjjkk----
+// imm        skkjjjiiiiii
+static inline unsigned _I12(unsigned n) {
+	return ((n & 0x3F) << 9) | (n & 0x1C0) | ((n & 0x600) >> 5) | ((n & 0x800) << 4);
+}
+
+int is_signed9(unsigned n) {
+	n &= 0xFFFFFF00;
+	return ((n == 0) || (n == 0xFFFFFF00));
+}
+
+int is_signed12(unsigned n) {
+	n &= 0xFFFFF800;
+	return ((n == 0) || (n == 0xFFFFF800));
+}
+
+// ---- regions ----
+
+#define MAXREGIONS 16
+
+struct region {
+	char name[64];
+	unsigned base;
+	unsigned limit;
+	int follows;    // region this one starts after, or -1
+	unsigned load;
+	unsigned next;  // where the next section goes
+};
+
+// the cpu16 system memory map: ram from 0, vram at 0x8000, io at 0xF000
+struct region regions[MAXREGIONS] = {
+	{ "code", 0x0000, 0x8000, -1, 1, 0 },
+	{ "data", 0x0000, 0x8000,  0, 1, 0 },
+	{ "vram", 0x8000, 0x8800, -1, 0, 0 },
+	{ "io",   0xF000, 0x10000, -1, 0, 0 },
+};
+unsigned region_count = 4;
+
+struct region *findregion(const char *name) {
+	unsigned n;
+	for (n = 0; n < region_count; n++)
+		if (!strcasecmp(regions[n].name, name))
+			return regions + n;
+	return 0;
+}
+
+// -region name=base[:size]
+void setregion(const char *arg) {
+	char name[64];
+	unsigned base, size;
+	struct region *r;
+	int n = sscanf(arg, "%63[^=]=%i:%i", name, &base, &size);
+	if (n < 2) die("bad region '%s'", arg);
+	if (!(r = findregion(name))) {
+		if (region_count == MAXREGIONS) die("too many regions");
+		r = regions + region_count++;
+		strcpy(r->name, name);
+		r->load = 1;
+	}
+	r->base = base;
+	r->limit = (n == 3) ? base + size : 0x10000;
+	r->follows = -1;
+}
+
+// ---- objects ----
+
+#define MAXSECTIONS 4096
+
+struct reloc {
+	struct reloc *next;
+	char *name;
+	unsigned offset;
+	unsigned type;
+};
+
+struct section {
+	char name[64];
+	struct region *region;
+	const char *file;
+	unsigned obj;
+	unsigned size;
+	u16 *data;
+	struct reloc *relocs;
+	unsigned live;
+	unsigned addr;
+};
+
+struct section sections[MAXSECTIONS];
+unsigned section_count;
+
+struct symbol {
+	struct symbol *next;
+	char *name;
+	unsigned obj;
+	unsigned global;
+	unsigned section;
+	unsigned offset;
+};
+
+// case-insensitive, as a16 labels are
+#define SYMBOL_HASH 1024
+struct symbol *symbols[SYMBOL_HASH];
+
+unsigned hashname(const char *s) {
+	unsigned h = 2166136261U;
+	while (*s) {
+		h ^= tolower(*s++);
+		h *= 16777619U;
+	}
+	return h & (SYMBOL_HASH - 1);
+}
+
+// a local of object obj, or any global
+struct symbol *findsymbol(const char *name, unsigned obj) {
+	struct symbol *s;
+	for (s = symbols[hashname(name)]; s; s = s->next)
+		if (((s->obj == obj) || s->global) && !strcasecmp(s->name, name))
+			return s;
+	return 0;
+}
+
+void addsymbol(const char *fn, unsigned obj, const char *name,
+		unsigned global, unsigned section, unsigned offset) {
+	struct symbol *s;
+	unsigned h = hashname(name);
+	if (global && (s = findsymbol(name, obj)) && s->global)
+		die("%s: '%s' already defined in %s", fn, name, sections[s->section].file);
+	if (!(s = malloc(sizeof(*s)))) die("out of memory");
+	s->name = strdup(name);
+	s->obj = obj;
+	s->global = global;
+	s->section = section;
+	s->offset = offset;
+	s->next = symbols[h];
+	symbols[h] = s;
+}
+
+void loadobj(const char *fn, unsigned obj) {
+	char kw[64], name[64], region[64];
+	unsigned first = section_count;
+	unsigned n, sec, off, type;
+	struct section *s;
+	struct reloc *r;
+
+	FILE *fp = fopen(fn, "r");
+	if (!fp) die("cannot open '%s'", fn);
+	if ((fscanf(fp, "%63s %u", kw, &n) != 2) || strcmp(kw, "a16obj") || (n != 1))
+		die("%s: not an a16 object", fn);
+
+	while (fscanf(fp, "%63s", kw) == 1) {
+		if (!strcmp(kw, "section")) {
+			if (section_count == MAXSECTIONS) die("too many sections");
+			s = sections + section_count++;
+			if (fscanf(fp, "%63s %63s %u", s->name, region, &s->size) != 3)
+				die("%s: bad section", fn);
+			if (!(s->region = findregion(region)))
+				die("%s: section '%s' in unknown region '%s'", fn, s->name, region);
+			s->file = fn;
+			s->obj = obj;
+			s->data = malloc((s->size + 1) * sizeof(u16));
+			if (!s->data) die("out of memory");
+			for (n = 0; n < s->size; n++) {
+				if (fscanf(fp, "%x", &off) != 1) die("%s: short section '%s'", fn, s->name);
+				s->data[n] = off;
+			}
+		} else if (!strcmp(kw, "global") || !strcmp(kw, "local")) {
+			if ((fscanf(fp, "%63s %u %u", name, &sec, &off) != 3) ||
+				((first + sec) >= section_count))
+				die("%s: bad symbol", fn);
+			addsymbol(fn, obj, name, kw[0] == 'g', first + sec, off);
+		} else if (!strcmp(kw, "extern")) {
+			if (fscanf(fp, "%63s", name) != 1) die("%s: bad extern", fn);
+		} else if (!strcmp(kw, "reloc")) {
+			if ((fscanf(fp, "%u %u %u %63s", &sec, &off, &type, name) != 4) ||
+				((first + sec) >= section_count) ||
+				((off + (type == TYPE_ABS_MOVMHI)) >= sections[first + sec].size))
+				die("%s: bad reloc", fn);
+			s = sections + first + sec;
+			if (!(r = malloc(sizeof(*r)))) die("out of memory");
+			r->name = strdup(name);
+			r->offset = off;
+			r->type = type;
+			r->next = s->relocs;
+			s->relocs = r;
+		} else {
+			die("%s: unexpected '%s'", fn, kw);
+		}
+	}
+	fclose(fp);
+}
+
+struct symbol *target(struct section *s, struct reloc *r) {
+	struct symbol *sym = findsymbol(r->name, s->obj);
+	if (!sym) die("%s: undefined symbol '%s'", s->file, r->name);
+	return sym;
+}
+
+// ---- dead section elimination ----
+
+void mark(unsigned n) {
+	struct reloc *r;
+	if (sections[n].live) return;
+	sections[n].live = 1;
+	for (r = sections[n].relocs; r; r = r->next)
+		mark(target(sections + n, r)->section);
+}
+
+// ---- placement and relocation ----
+
+void place(void) {
+	struct region *rg;
+	struct section *s;
+	unsigned n, i;
+
+	for (n = 0; n < region_count; n++) {
+		rg = regions + n;
+		if (rg->follows >= 0)
+			rg->base = regions[rg->follows].next;
+		rg->next = rg->base;
+		for (i = 0; i < section_count; i++) {
+			s = sections + i;
+			if ((!s->live) || (s->region != rg)) continue;
+			if ((rg->next + s->size) > rg->limit)
+				die("region '%s' full placing '%s' from %s", rg->name, s->name, s->file);
+			s->addr = rg->next;
+			rg->next += s->size;
+		}
+	}
+}
+
+void relocate(void) {
+	struct section *s;
+	struct symbol *sym;
+	struct reloc *r;
+	unsigned n, pc, addr, d;
+
+	for (n = 0; n < section_count; n++) {
+		s = sections + n;
+		if (!s->live) continue;
+		for (r = s->relocs; r; r = r->next) {
+			sym = target(s, r);
+			addr = sections[sym->section].addr + sym->offset;
+			pc = s->addr + r->offset;
+			d = addr - pc - 1;
+			switch (r->type) {
+			case TYPE_PCREL_S9:
+				if (!is_signed9(d)) goto range;
+				s->data[r->offset] |= _I9(d);
+				break;
+			case TYPE_PCREL_S12:
+				if (!is_signed12(d)) goto range;
+				s->data[r->offset] |= _I12(d);
+				break;
+			case TYPE_ABS_U16:
+				s->data[r->offset] = addr;
+				break;
+			case TYPE_ABS_MOVMHI:
+				s->data[r->offset] |= _I10(addr);
+				s->data[r->offset + 1] |= _I7(addr >> 10);
+				break;
+			default:
+				die("%s: unknown reloc type %u", s->file, r->type);
+			}
+			continue;
+		range:
+			die("%s: '%s' at %04x is out of range of %04x (use a register branch)",
+				s->file, r->name, addr, pc);
+		}
+	}
+}
+
+// ---- output ----
+
+u16 image[65536];
+const char *image_label[65536];
+unsigned image_size;
+
+void build(void) {
+	struct section *s;
+	struct symbol *sym;
+	unsigned n;
+
+	for (n = 0; n < section_count; n++) {
+		s = sections + n;
+		if ((!s->live) || (!s->region->load)) continue;
+		memcpy(image + s->addr, s->data, s->size * sizeof(u16));
+		if ((s->addr + s->size) > image_size)
+			image_size = s->addr + s->size;
+	}
+	for (n = 0; n < SYMBOL_HASH; n++) {
+		for (sym = symbols[n]; sym; sym = sym->next) {
+			s = sections + sym->section;
+			if (s->live && s->region->load && (sym->offset < s->size))
+				image_label[s->addr + sym->offset] = sym->name;
+		}
+	}
+}
+
+void save(const char *fn) {
+	unsigned n;
+	char dis[128];
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	for (n = 0; n < image_size; n++) {
+		disassemble(dis, n, image[n]);
+		if (image_label[n]) {
+			fprintf(fp, "%04x  // %04x: %-25s <- %s\n", image[n], n, dis, image_label[n]);
+		} else {
+			fprintf(fp, "%04x  // %04x: %s\n", image[n], n, dis);
+		}
+	}
+	fclose(fp);
+}
+
+// raw little-endian 16bit words
+void save_bin(const char *fn) {
+	unsigned n;
+
+	FILE *fp = fopen(fn, "wb");
+	if (!fp) die("cannot write to '%s'", fn);
+	for (n = 0; n < image_size; n++) {
+		fputc(image[n] & 0xFF, fp);
+		fputc(image[n] >> 8, fp);
+	}
+	fclose(fp);
+}
+
+// where each region and section went, and what was dropped
+void save_map(const char *fn) {
+	struct section *s;
+	struct symbol *sym;
+	unsigned n, i;
+
+	FILE *fp = fopen(fn, "w");
+	if (!fp) die("cannot write to '%s'", fn);
+	for (n = 0; n < region_count; n++) {
+		fprintf(fp, "region %-8s %04x-%04x %5u words used%s\n", regions[n].name,
+			regions[n].base, regions[n].limit - 1, regions[n].next - regions[n].base,
+			regions[n].load ? "" : " (not loaded)");
+		for (i = 0; i < section_count; i++) {
+			s = sections + i;
+			if (s->live && (s->region == regions + n))
+				fprintf(fp, "  %04x %5u %-16s %s\n", s->addr, s->size, s->name, s->file);
+		}
+	}
+	for (i = 0; i < section_count; i++) {
+		s = sections + i;
+		if (!s->live)
+			fprintf(fp, "dropped  %5u %-16s %s\n", s->size, s->name, s->file);
+	}
+	for (n = 0; n < SYMBOL_HASH; n++) {
+		for (sym = symbols[n]; sym; sym = sym->next) {
+			s = sections + sym->section;
+			if (sym->global && s->live)
+				fprintf(fp, "symbol %04x %s\n", s->addr + sym->offset, sym->name);
+		}
+	}
+	fclose(fp);
+}
+
+void usage(void) {
+	fprintf(stderr,
+		"usage:   l16 [ <option> ]* <object>+\n"
+		"\n"
+		"option:  -hex <file>            hex words with disassembly (default out.hex)\n"
+		"         -bin <file>            raw little-endian words\n"
+		"         -map <file>            section and symbol addresses\n"
+		"         -region <name>=<base>[:<size>]\n"
+		"                                place a region (default code=0:0x8000,\n"
+		"                                data after code, vram=0x8000:0x800,\n"
+		"                                io=0xF000:0x1000)\n"
+		"         -gc                    drop sections nothing refers to\n"
+		"         -keep <symbol>         keep the section of a symbol (with -gc)\n"
+		);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	const char *hexname = 0;
+	const char *binname = 0;
+	const char *mapname = 0;
+	const char *keep[64];
+	unsigned keep_count = 0;
+	unsigned obj_count = 0;
+	struct symbol *sym;
+	int gc = 0;
+	unsigned n;
+
+	argc--;
+	argv++;
+	while (argc > 0) {
+		if (!strcmp(argv[0], "-gc")) {
+			gc = 1;
+			argc--;
+			argv++;
+			continue;
+		}
+		if (argv[0][0] == '-') {
+			if (argc < 2) usage();
+			if (!strcmp(argv[0], "-hex")) {
+				hexname = argv[1];
+			} else if (!strcmp(argv[0], "-bin")) {
+				binname = argv[1];
+			} else if (!strcmp(argv[0], "-map")) {
+				mapname = argv[1];
+			} else if (!strcmp(argv[0], "-region")) {
+				setregion(argv[1]);
+			} else if (!strcmp(argv[0], "-keep")) {
+				if (keep_count == 64) die("too many -keep symbols");
+				keep[keep_count++] = argv[1];
+			} else {
+				usage();
+			}
+			argc -= 2;
+			argv += 2;
+			continue;
+		}
+		loadobj(argv[0], obj_count++);
+		argc--;
+		argv++;
+	}
+
+	if (section_count == 0)
+		usage();
+	if (!hexname && !binname && !mapname)
+		hexname = "out.hex";
+
+	if (gc) {
+		mark(0);
+		for (n = 0; n < keep_count; n++) {
+			sym = findsymbol(keep[n], -1);
+			if (!sym || !sym->global) die("cannot keep undefined symbol '%s'", keep[n]);
+			mark(sym->section);
+		}
+	} else {
+		for (n = 0; n < section_count; n++)
+			sections[n].live = 1;
+	}
+
+	place();
+	relocate();
+	build();
+	if (hexname) save(hexname);
+	if (binname) save_bin(binname);
+	if (mapname) save_map(mapname);
+	return 0;
+}
@@ -0,0 +1,63 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// DPI support for the SDRAM controller benchmark (hdl/sdram/bench.sv)
+// - collects read latency samples
+// - reports throughput, efficiency, and latency percentiles
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Vtestbench__Dpi.h"
+#include "sim-sdram.h"
+
+static std::vector<uint32_t> samples;
+
+static const char* pattern_name(int n) {
+	switch (n) {
+	case 0: return "seq-read";
+	case 1: return "seq-write";
+	case 2: return "rand-read";
+	case 3: return "rand-write";
+	case 4: return "interleave";
+	case 5: return "mix";
+	case 6: return "scanout";
+	default: return "unknown";
+	}
+}
+
+void dpi_bench_latency(int cycles) {
+	samples.push_back(cycles);
+}
+
+static uint32_t percentile(unsigned pct) {
+	if (samples.size() == 0) {
+		return 0;
+	}
+	return samples[(samples.size() - 1) * pct / 100];
+}
+
+void dpi_bench_done(int pattern, int len, int cycles, int rd_words, int wr_words) {
+	unsigned mhz = sim_sdram_get_clock();
+	double words = (double) rd_words + wr_words;
+	double mbps = cycles ? (words * 2.0 * mhz / cycles) : 0;
+	double eff = cycles ? (words * 100.0 / cycles) : 0;
+	double avg = 0;
+
+	std::sort(samples.begin(), samples.end());
+	for (uint32_t n : samples) {
+		avg += n;
+	}
+	if (samples.size()) {
+		avg /= samples.size();
+	}
+
+	// one line, for build/sdram-bench to parse
+	printf("BENCH: pattern=%s len=%d cycles=%d rd=%d wr=%d mbps=%.1f eff=%.1f "
+		"lat_avg=%.1f lat_p50=%u lat_p90=%u lat_p99=%u lat_max=%u\n",
+		pattern_name(pattern), len, cycles, rd_words, wr_words, mbps, eff,
+		avg, percentile(50), percentile(90), percentile(99), percentile(100));
+}
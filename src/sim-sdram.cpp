@@ -6,44 +6,70 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "sim-sdram.h"
 
 // Geometry and Timing Configuration
 //
-#if 1
-#define BANKBITS 1
-#define COLBITS  8
-#define ROWBITS  11
-#else
-#define BANKBITS 2
-#define COLBITS  9
-#define ROWBITS  13
-#endif
+// Parameter names match those of hdl/sdram/sdram.sv.  Defaults
+// match the 1Mx16x2 part on the Colorlight 5A-75B.  Timing is
+// in clocks, the refresh interval (0 = unchecked) in clocks too.
+//
+static struct {
+	unsigned BANKBITS, ROWBITS, COLBITS;
+	unsigned T_RCD, T_RC, T_RRD, T_RP, T_WR, T_MRD, T_RI;
+	unsigned CL;  // minimum CAS latency supported at this clock
+	unsigned MHZ; // clock rate, for bandwidth statistics
+	unsigned TLM_LATENCY; // read ack to data, for sdram_tlm.sv
+	unsigned TLM_JITTER;  // ... plus uniformly 0..TLM_JITTER
+} cfg = {
+	1, 11, 8,
+	3, 8, 3, 3, 2, 3, 0,
+	2,
+	100,
+	8, 0,
+};
 
-#define tRCD 3
-#define tRC  8
-#define tRRD 3
-#define tRP  3
-#define tWR  2
-#define tMRD 3
+static const struct {
+	const char* name;
+	unsigned* ptr;
+	unsigned min;
+	unsigned max;
+} params[] = {
+	{ "BANKBITS", &cfg.BANKBITS, 0, 2 },
+	{ "ROWBITS", &cfg.ROWBITS, 11, 13 },
+	{ "COLBITS", &cfg.COLBITS, 8, 10 },
+	{ "T_RCD", &cfg.T_RCD, 1, 16 },
+	{ "T_RC", &cfg.T_RC, 1, 32 },
+	{ "T_RRD", &cfg.T_RRD, 1, 16 },
+	{ "T_RP", &cfg.T_RP, 1, 16 },
+	{ "T_WR", &cfg.T_WR, 1, 16 },
+	{ "T_MRD", &cfg.T_MRD, 1, 16 },
+	{ "T_RI", &cfg.T_RI, 0, 65535 },
+	{ "CL", &cfg.CL, 1, 3 },
+	{ "MHZ", &cfg.MHZ, 1, 1000 },
+	{ "TLM_LATENCY", &cfg.TLM_LATENCY, 1, 1000 },
+	{ "TLM_JITTER", &cfg.TLM_JITTER, 0, 1000 },
+};
+
+#define MAXBANKS  4
 
 // Derived Parameters
 //
-#define ALLBITS   (ROWBITS + BANKBITS + COLBITS)
-#define ALLWORDS  (1 << ALLBITS)
-
-#define BANKS     (1 << BANKBITS)
-#define ROWS      (1 << ROWBITS)
-#define COLS      (1 << COLBITS)
+#define BANKS     (1U << cfg.BANKBITS)
+#define ROWS      (1U << cfg.ROWBITS)
+#define COLS      (1U << cfg.COLBITS)
 
 #define BANKMASK  (BANKS - 1)
 #define ROWMASK   (ROWS - 1)
 #define COLMASK   (COLS - 1)
 
+#define ALLWORDS  (1U << (cfg.ROWBITS + cfg.BANKBITS + cfg.COLBITS))
+
 #define ADDR(bank, row, col) (\
-	(((bank) & BANKMASK) << (ROWBITS + COLBITS)) |\
-	(((row) & ROWMASK) << (COLBITS)) |\
+	(((bank) & BANKMASK) << (cfg.ROWBITS + cfg.COLBITS)) |\
+	(((row) & ROWMASK) << (cfg.COLBITS)) |\
 	((col) & COLMASK))
 
 #define CMD_SET_MODE  0b000
@@ -58,11 +84,13 @@
 #define BANK_UNKNOWN    0
 #define BANK_IDLE       1
 #define BANK_ACTIVE     2
-#define BANK_READ       3
-#define BANK_WRITE      4
-#define BANK_PRECHARGE  5
-#define BANK_REFRESH    6
-#define BANK_OPENING    7
+
+// timestamp of events that have not happened
+#define NEVER (-(1LL << 40))
+
+// read data pipe (indexed by cycle), must exceed the max CL
+#define PIPE_SIZE 8
+#define PIPE_MASK (PIPE_SIZE - 1)
 
 static const char* cname(unsigned n) {
 	switch (n) {
@@ -83,240 +111,599 @@ static const char* sname(unsigned n) {
 	case BANK_UNKNOWN:    return "UNKN";
 	case BANK_IDLE:       return "IDLE";
 	case BANK_ACTIVE:     return "ACTV";
-	case BANK_READ:       return "READ";
-	case BANK_WRITE:      return "WRIT";
-	case BANK_PRECHARGE:  return "PCHG";
-	case BANK_REFRESH:    return "REFR";
-	case BANK_OPENING:    return "OPEN";
 	default: return "INVL";
 	}
 }
 
 #define SN(n) sname(bank[n].state)
 
-
-struct {
+static struct {
 	unsigned state;
 	unsigned rowaddr;
-	unsigned busy; // cycles until activated, precharged
-} bank[BANKS];
+
+	int64_t t_active;    // last ACTIVE
+	int64_t t_precharge; // last PRECHARGE (or auto precharge start)
+	int64_t t_write;     // last word written
+
+	// statistics support
+	unsigned fresh; // ACTIVE issued, no READ/WRITE yet
+	unsigned closed; // a row was closed by PRECHARGE (vs REFRESH)
+	unsigned closed_row; // ... and this was that row
+	unsigned pending; // PRECHARGE/ACTIVE issued for an access
+	int64_t t_start; // ... and this is when the first was
+} bank[MAXBANKS];
+
+static struct {
+	uint64_t cycles;
+	uint64_t cmds[8];
+	uint64_t rd_words;
+	uint64_t wr_words;
+	uint64_t busy; // cycles the data bus was transferring data
+	uint64_t hit[MAXBANKS]; // READ/WRITE to an already open row
+	uint64_t miss[MAXBANKS]; // ACTIVE of an idle bank
+	uint64_t conflict[MAXBANKS]; // ACTIVE after closing a different row
+	uint64_t lat_total;
+	uint64_t lat_count;
+	uint64_t lat_max;
+} stats;
+
+static int log_level = 0;
+static FILE* trace_fp = NULL;
+static int tlm_used = 0;
+static uint32_t tlm_rng = 0xebd5a728;
 
 static struct {
-	unsigned pipe_data_o[tRCD]; // data out pipe
-	unsigned pipe_data_e[tRCD]; // data exists pipe
-	unsigned rd_burst;
-	unsigned wr_burst;
-
-	// activity
-	unsigned state; // BANK_READ or _WRITE
-	unsigned bankno; // bank number 
-	unsigned count; // remaining cycles of that state
-	unsigned addr;
+	// mode register
+	unsigned cl;
+	unsigned bl; // burst length (COLS for full page)
+	unsigned single_write; // write burst mode: single location
+
+	// read data in flight, slot [n & PIPE_MASK] is driven in cycle n
+	unsigned pipe_data_o[PIPE_SIZE];
+	unsigned pipe_data_e[PIPE_SIZE];
+	int64_t pipe_data_t[PIPE_SIZE]; // data latency start (or NEVER)
+
+	// burst in progress
+	unsigned active;
+	unsigned write;
+	unsigned bankno;
+	unsigned col; // next column
+	unsigned count; // remaining words
 	unsigned ap; // auto-precharge
+
+	int64_t t_active; // last ACTIVE of any bank
+	unsigned active_bank; // ... and its bank
+	int64_t t_refresh; // last REFRESH
+	int64_t t_mode; // last SET_MODE
+	unsigned last_cmd; // previous cycle's command
 } sdram;
 
-//  RD Bn Rnnnnn Cnnn -- Bn XXXXXXXX NNNN  Bn XXXXXXXX NNNN 
-//  
-static uint16_t memory[ALLWORDS];
+// Memory is allocated a page at a time on the first write to it.
+// Pages start filled with 0xFE, and reads of untouched pages return
+// that pattern without allocating, so startup time and RSS scale
+// with the memory a sim actually writes, not the part's size.
+#define PAGEBITS  12
+#define PAGEWORDS (1U << PAGEBITS)
+#define PAGEMASK  (PAGEWORDS - 1)
+
+static uint16_t** pages;
+static unsigned pagecount;
+
+static unsigned mem_rd(unsigned addr) {
+	uint16_t* page = pages[addr >> PAGEBITS];
+	return page ? page[addr & PAGEMASK] : 0xFEFE;
+}
+
+static uint16_t* mem_ptr(unsigned addr) {
+	uint16_t** page = pages + (addr >> PAGEBITS);
+	if (*page == NULL) {
+		*page = (uint16_t*) malloc(PAGEWORDS * 2);
+		if (*page == NULL) {
+			return NULL;
+		}
+		memset(*page, 0xFE, PAGEWORDS * 2);
+	}
+	return *page + (addr & PAGEMASK);
+}
 
 void sim_dump(void) {
 	for (unsigned n = 0; n < BANKS; n++) {
-		printf("B%u %-4s %04x  ", n, SN(n), bank[n].busy);
+		printf("B%u %-4s %04x  ", n, SN(n), bank[n].rowaddr);
 	}
-	if (sdram.state != BANK_IDLE) {
+	if (sdram.active) {
 		printf("%s B%u R%05x C%03x (%u)\n",
-			sdram.state == BANK_WRITE ? "WR" : "RD",
+			sdram.write ? "WR" : "RD",
 			sdram.bankno, bank[sdram.bankno].rowaddr,
-			sdram.addr & COLMASK, sdram.count);
+			sdram.col, sdram.count);
 	} else {
 		printf("\n");
 	}
 }
 
+int sim_sdram_config(const char* opts) {
+	char* tmp = strdup(opts);
+	char* save;
+	int r = 0;
+	for (char* kv = strtok_r(tmp, ",", &save); kv != NULL; kv = strtok_r(NULL, ",", &save)) {
+		char* val = strchr(kv, '=');
+		unsigned n;
+		if (val != NULL) {
+			*val++ = 0;
+		}
+		for (n = 0; n < sizeof(params) / sizeof(params[0]); n++) {
+			if (!strcmp(kv, params[n].name)) break;
+		}
+		if (n == sizeof(params) / sizeof(params[0])) {
+			fprintf(stderr, "sdram: unknown parameter '%s'\n", kv);
+			r = -1;
+			break;
+		}
+		char* end;
+		unsigned long v = (val == NULL) ? 0 : strtoul(val, &end, 0);
+		if ((val == NULL) || (*val == 0) || (*end != 0) ||
+			(v < params[n].min) || (v > params[n].max)) {
+			fprintf(stderr, "sdram: %s must be %u..%u\n", params[n].name,
+				params[n].min, params[n].max);
+			r = -1;
+			break;
+		}
+		*params[n].ptr = v;
+	}
+	free(tmp);
+	return r;
+}
+
 void sim_sdram_init(void) {
 	memset(bank, 0, sizeof(bank));
 	memset(&sdram, 0, sizeof(sdram));
-	memset(memory, 0xFE, ALLWORDS * 2);
-	sdram.rd_burst = 1;
-	sdram.wr_burst = 1;
-	sdram.state = BANK_IDLE;
+	memset(&stats, 0, sizeof(stats));
+	for (unsigned n = 0; n < pagecount; n++) {
+		free(pages[n]);
+	}
+	free(pages);
+	pagecount = (ALLWORDS + PAGEMASK) >> PAGEBITS;
+	pages = (uint16_t**) calloc(pagecount, sizeof(uint16_t*));
+	if (pages == NULL) {
+		printf("sdram: out of memory\n");
+		exit(1);
+	}
+	for (unsigned n = 0; n < MAXBANKS; n++) {
+		bank[n].t_active = NEVER;
+		bank[n].t_precharge = NEVER;
+		bank[n].t_write = NEVER;
+	}
+	for (unsigned n = 0; n < PIPE_SIZE; n++) {
+		sdram.pipe_data_t[n] = NEVER;
+	}
+	sdram.cl = cfg.CL;
+	sdram.bl = 1;
+	sdram.t_active = NEVER;
+	sdram.t_refresh = NEVER;
+	sdram.t_mode = NEVER;
+	sdram.last_cmd = CMD_NOP;
+}
+
+void sim_sdram_log(int level) {
+	log_level = level;
+}
+
+void sim_sdram_clock(unsigned mhz) {
+	cfg.MHZ = mhz;
+}
+
+unsigned sim_sdram_get_clock(void) {
+	return cfg.MHZ;
+}
+
+int sim_sdram_trace(const char* fn) {
+	if ((trace_fp = fopen(fn, "wb")) == NULL) {
+		fprintf(stderr, "sdram: cannot open '%s' for writing\n", fn);
+		return -1;
+	}
+	return 0;
+}
+
+static void trace_cmd(unsigned ctl, unsigned addr, unsigned data) {
+	sim_sdram_trace_t rec;
+	rec.cycle = stats.cycles;
+	rec.cmd = ctl;
+	rec.bank = (addr >> cfg.ROWBITS) & BANKMASK;
+	rec.data = data;
+	rec.addr = addr;
+	fwrite(&rec, sizeof(rec), 1, trace_fp);
+}
+
+static void note_access(unsigned n) {
+	if (bank[n].fresh) {
+		bank[n].fresh = 0;
+	} else {
+		stats.hit[n]++;
+	}
+	bank[n].pending = 0;
+}
+
+static void note_setup(unsigned n) {
+	if (!bank[n].pending) {
+		bank[n].pending = 1;
+		bank[n].t_start = stats.cycles;
+	}
+}
+
+void sim_sdram_stats(void) {
+	uint64_t cycles = stats.cycles ? stats.cycles : 1;
+	if (tlm_used) {
+		printf("sdram: transaction-level: read %llu words, write %llu words\n",
+			(unsigned long long) stats.rd_words,
+			(unsigned long long) stats.wr_words);
+		if (stats.lat_count) {
+			printf("sdram: read latency avg %.1f max %llu cycles (%llu reads)\n",
+				(double) stats.lat_total / stats.lat_count,
+				(unsigned long long) stats.lat_max,
+				(unsigned long long) stats.lat_count);
+		}
+		return;
+	}
+	printf("sdram: %llu cycles at %u MHz\n",
+		(unsigned long long) stats.cycles, cfg.MHZ);
+	printf("sdram: commands:");
+	for (unsigned n = 0; n < 8; n++) {
+		if (n == CMD_NOP) continue;
+		printf(" %s=%llu", cname(n), (unsigned long long) stats.cmds[n]);
+	}
+	printf("\n");
+	for (unsigned n = 0; n < BANKS; n++) {
+		uint64_t total = stats.hit[n] + stats.miss[n] + stats.conflict[n];
+		if (total == 0) total = 1;
+		printf("sdram: bank%u: hit %llu (%.1f%%) miss %llu (%.1f%%) conflict %llu (%.1f%%)\n", n,
+			(unsigned long long) stats.hit[n], stats.hit[n] * 100.0 / total,
+			(unsigned long long) stats.miss[n], stats.miss[n] * 100.0 / total,
+			(unsigned long long) stats.conflict[n], stats.conflict[n] * 100.0 / total);
+	}
+	printf("sdram: bus utilization %.1f%% (%llu of %llu cycles)\n",
+		stats.busy * 100.0 / cycles,
+		(unsigned long long) stats.busy, (unsigned long long) stats.cycles);
+	printf("sdram: read %llu words (%.1f MB/s), write %llu words (%.1f MB/s)\n",
+		(unsigned long long) stats.rd_words, stats.rd_words * 2.0 * cfg.MHZ / cycles,
+		(unsigned long long) stats.wr_words, stats.wr_words * 2.0 * cfg.MHZ / cycles);
+	if (stats.lat_count) {
+		printf("sdram: read latency avg %.1f max %llu cycles (%llu reads)\n",
+			(double) stats.lat_total / stats.lat_count,
+			(unsigned long long) stats.lat_max,
+			(unsigned long long) stats.lat_count);
+	}
+	if (trace_fp != NULL) {
+		fclose(trace_fp);
+		trace_fp = NULL;
+	}
+}
+
+// verify that at least 'need' clocks have passed since event 'what'
+// (at cycle 'then') before issuing command 'cmd' to bank 'n'
+static int check(unsigned cmd, unsigned n, const char* param,
+		 unsigned need, const char* what, int64_t then) {
+	int64_t now = stats.cycles;
+	if ((now - then) >= need) {
+		return 0;
+	}
+	printf("sdram: %llu: %s bank%u violates %s: %lld clocks after %s at %llu (need %u)\n",
+		(unsigned long long) now, cname(cmd), n, param,
+		(long long) (now - then), what, (unsigned long long) then, need);
+	return -1;
+}
+
+// end the burst in progress, possibly starting an auto precharge
+static void burst_end(void) {
+	unsigned n = sdram.bankno;
+	if (sdram.active && sdram.ap) {
+		bank[n].state = BANK_IDLE;
+		bank[n].t_precharge = sdram.write ?
+			(bank[n].t_write + cfg.T_WR) : (int64_t) stats.cycles;
+		bank[n].closed = 1;
+		bank[n].closed_row = bank[n].rowaddr;
+	}
+	sdram.active = 0;
+}
+
+// PRECHARGE of bank n, which need not be active
+static int precharge(unsigned n) {
+	if (bank[n].state == BANK_IDLE) {
+		return 0; // NOP
+	}
+	if (bank[n].state == BANK_ACTIVE) {
+		// tRAS (ACTIVE to PRECHARGE) is what remains of tRC after tRP
+		unsigned t_ras = (cfg.T_RC > cfg.T_RP) ? (cfg.T_RC - cfg.T_RP) : 0;
+		if (check(CMD_PRECHARGE, n, "tRAS", t_ras,
+			"ACTIVE", bank[n].t_active) ||
+			check(CMD_PRECHARGE, n, "tWR", cfg.T_WR,
+			"last write", bank[n].t_write)) {
+			return -1;
+		}
+		bank[n].closed = 1;
+		bank[n].closed_row = bank[n].rowaddr;
+	}
+	if (sdram.active && (sdram.bankno == n)) {
+		// truncates the burst (no auto precharge)
+		sdram.active = 0;
+	}
+	bank[n].state = BANK_IDLE;
+	bank[n].t_precharge = stats.cycles;
+	return 0;
+}
+
+// all banks must be idle and precharged for SET_MODE and REFRESH
+static int check_all_idle(unsigned ctl) {
+	for (unsigned n = 0; n < BANKS; n++) {
+		if (bank[n].state != BANK_IDLE) {
+			printf("sdram: %llu: %s bank%u not idle (%s)\n",
+				(unsigned long long) stats.cycles, cname(ctl), n, SN(n));
+			return -1;
+		}
+		if (check(ctl, n, "tRP", cfg.T_RP, "PRECHARGE", bank[n].t_precharge)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int set_mode(unsigned mode) {
+	unsigned cl = (mode >> 4) & 7;
+	unsigned bl = mode & 7;
+	if (mode & 0x8) {
+		printf("sdram: %llu: MODE interleaved bursts not supported\n",
+			(unsigned long long) stats.cycles);
+		return -1;
+	}
+	if ((cl < 1) || (cl > 3)) {
+		printf("sdram: %llu: MODE reserved CAS latency %u\n",
+			(unsigned long long) stats.cycles, cl);
+		return -1;
+	}
+	if (cl < cfg.CL) {
+		printf("sdram: %llu: MODE CAS latency %u below minimum of %u\n",
+			(unsigned long long) stats.cycles, cl, cfg.CL);
+		return -1;
+	}
+	if (bl == 7) {
+		bl = COLS;
+	} else if (bl < 4) {
+		bl = 1 << bl;
+	} else {
+		printf("sdram: %llu: MODE reserved burst length %u\n",
+			(unsigned long long) stats.cycles, bl);
+		return -1;
+	}
+	sdram.cl = cl;
+	sdram.bl = bl;
+	sdram.single_write = (mode >> 9) & 1;
+	return 0;
 }
 
 int sim_sdram(unsigned ctl, unsigned addr, unsigned din, unsigned* dout) {
-	unsigned a_bank = (addr >> ROWBITS) & BANKMASK;
+	int64_t now = stats.cycles;
+	unsigned a_bank = (addr >> cfg.ROWBITS) & BANKMASK;
 	unsigned a_row = addr & ROWMASK;
 	unsigned a_col = addr & COLMASK;
 	unsigned a_a10 = (addr >> 10) & 1;
+	unsigned slot = now & PIPE_MASK;
 
-	printf("(%-4s) %06x %04x  ", cname(ctl), addr, din);
-	for (unsigned n = 0; n < 3; n++) {
-		if (sdram.pipe_data_e[n]) {
-			printf("<%04x", sdram.pipe_data_o[n]);
-		} else {
-			printf("<----");
+	if ((log_level > 1) || ((log_level > 0) && (ctl != CMD_NOP))) {
+		printf("%8llu (%-4s) %06x %04x  ",
+			(unsigned long long) now, cname(ctl), addr, din);
+		for (unsigned n = 0; n < sdram.cl; n++) {
+			unsigned s = (now + n) & PIPE_MASK;
+			if (sdram.pipe_data_e[s]) {
+				printf("<%04x", sdram.pipe_data_o[s]);
+			} else {
+				printf("<----");
+			}
 		}
+		printf("<  ");
+		sim_dump();
+	}
+	if ((trace_fp != NULL) && (ctl != CMD_NOP)) {
+		trace_cmd(ctl, addr, din);
 	}
-	printf("<  ");
-	sim_dump();
+	stats.cmds[ctl & 7]++;
 
-	// drain output data pipe
-	if (sdram.pipe_data_e[0]) {
-		*dout = sdram.pipe_data_o[0];
+	// drive read data due this cycle
+	unsigned rd_driven = 0;
+	if (sdram.pipe_data_e[slot]) {
+		*dout = sdram.pipe_data_o[slot];
+		rd_driven = 1;
+		stats.busy++;
+		if (sdram.pipe_data_t[slot] != NEVER) {
+			uint64_t lat = now - sdram.pipe_data_t[slot];
+			stats.lat_total += lat;
+			stats.lat_count++;
+			if (lat > stats.lat_max) stats.lat_max = lat;
+		}
 	} else {
 		*dout = 0xE7E7; // DEBUG AID
 	}
-	sdram.pipe_data_e[0] = sdram.pipe_data_e[1];
-	sdram.pipe_data_o[0] = sdram.pipe_data_o[1];
-	sdram.pipe_data_e[1] = sdram.pipe_data_e[2];
-	sdram.pipe_data_o[1] = sdram.pipe_data_o[2];
-	sdram.pipe_data_e[2] = 0;
-	sdram.pipe_data_o[2] = 0;
+	sdram.pipe_data_e[slot] = 0;
+	sdram.pipe_data_t[slot] = NEVER;
 
-	// process bank timers
-	for (unsigned n = 0; n < BANKS; n++) {
-		if (bank[n].busy == 0) continue;
-		bank[n].busy--;
-		if (bank[n].busy != 0) continue;
-		switch (bank[n].state) {
-		case BANK_PRECHARGE:
-			bank[n].state = BANK_IDLE;
-			break;
-		case BANK_REFRESH:
-			bank[n].state = BANK_IDLE;
-			break;
-		case BANK_OPENING:
-			bank[n].state = BANK_ACTIVE;
-			break;
-		default:
-			printf("sdram: bank%d bad timer state %s\n", n, SN(n));
-			return -1;
-		}
+	// nothing but NOP may follow a SET_MODE for tMRD
+	if ((ctl != CMD_NOP) &&
+		check(ctl, a_bank, "tMRD", cfg.T_MRD, "SET_MODE", sdram.t_mode)) {
+		return -1;
 	}
-	
+
 	switch (ctl) {
 	case CMD_SET_MODE:
+		if (check_all_idle(ctl) ||
+			check(ctl, a_bank, "tRC", cfg.T_RC, "REFRESH", sdram.t_refresh) ||
+			set_mode(addr & 0x3FF)) {
+			return -1;
+		}
+		sdram.t_mode = now;
+		break;
 	case CMD_REFRESH:
+		if (check_all_idle(ctl) ||
+			check(ctl, a_bank, "tRC", cfg.T_RC, "REFRESH", sdram.t_refresh)) {
+			return -1;
+		}
+		if (cfg.T_RI && (sdram.t_refresh != NEVER) &&
+			((now - sdram.t_refresh) > cfg.T_RI)) {
+			printf("sdram: %llu: REFRESH %lld clocks after REFRESH at %llu (max %u)\n",
+				(unsigned long long) now, (long long) (now - sdram.t_refresh),
+				(unsigned long long) sdram.t_refresh, cfg.T_RI);
+			return -1;
+		}
+		sdram.t_refresh = now;
 		for (unsigned n = 0; n < BANKS; n++) {
-			if (bank[n].state != BANK_IDLE) {
-				printf("sdram: bank%d not idle for %s\n", n,
-					(ctl == CMD_SET_MODE) ? "SET_MODE" : "REFRESH");
-				return -1;
-			}
+			bank[n].closed = 0;
+			bank[n].pending = 0;
 		}
-		// TODO
 		break;
 	case CMD_PRECHARGE:
-		for (unsigned n = 0; n < BANKS; n++) {
-			if (a_a10 || (a_bank == n)) {
-				if (bank[n].state == BANK_IDLE) {
-					continue; // NOP
-				}
-				if ((bank[n].state == BANK_READ) ||
-				    (bank[n].state == BANK_WRITE)) { 
-					bank[n].state = BANK_ACTIVE;
-					sdram.state = BANK_IDLE;
-					continue; // cancel ongoing R/W
-				}
-				if ((bank[n].state == BANK_ACTIVE) ||
-					(bank[n].state == BANK_UNKNOWN)) {
-					bank[n].state = BANK_PRECHARGE;
-					bank[n].busy = tRP - 1;
-					continue;
-				}
-				printf("sdram: bank%d cannot PRECHARGE from %s\n", n, SN(n));
-				return -1;
+		if (a_a10) {
+			for (unsigned n = 0; n < BANKS; n++) {
+				if (precharge(n)) return -1;
 			}
+		} else {
+			note_setup(a_bank);
+			if (precharge(a_bank)) return -1;
 		}
 		break;
 	case CMD_ACTIVE:
 		if (bank[a_bank].state != BANK_IDLE) {
-			printf("sdram: bank%d cannot go ACTIVE from %s\n", a_bank, SN(a_bank));
+			printf("sdram: %llu: ACTIVE bank%u not idle (%s)\n",
+				(unsigned long long) now, a_bank, SN(a_bank));
+			return -1;
+		}
+		if (check(ctl, a_bank, "tRP", cfg.T_RP, "PRECHARGE", bank[a_bank].t_precharge) ||
+			check(ctl, a_bank, "tRC", cfg.T_RC, "ACTIVE", bank[a_bank].t_active) ||
+			check(ctl, a_bank, "tRC", cfg.T_RC, "REFRESH", sdram.t_refresh)) {
+			return -1;
+		}
+		if ((sdram.active_bank != a_bank) &&
+			check(ctl, a_bank, "tRRD", cfg.T_RRD, "ACTIVE of another bank", sdram.t_active)) {
 			return -1;
 		}
-		bank[a_bank].state = BANK_OPENING;
-		bank[a_bank].busy = tRP - 1;
+		bank[a_bank].state = BANK_ACTIVE;
+		bank[a_bank].rowaddr = a_row;
+		bank[a_bank].t_active = now;
+		sdram.t_active = now;
+		sdram.active_bank = a_bank;
+		if (bank[a_bank].closed && (bank[a_bank].closed_row != a_row)) {
+			stats.conflict[a_bank]++;
+		} else {
+			stats.miss[a_bank]++;
+		}
+		bank[a_bank].closed = 0;
+		bank[a_bank].fresh = 1;
+		note_setup(a_bank);
 		break;
 	case CMD_READ:
 	case CMD_WRITE:
-		if (bank[a_bank].state == BANK_WRITE) {
-			// truncate write, start new write burst
-		} else if (bank[a_bank].state == BANK_READ) {
-			// truncate read, start new write burst
-		} else if (bank[a_bank].state == BANK_ACTIVE) {
-			// cancel any r/w, start new
-			if (sdram.state != BANK_IDLE) {
-				unsigned n = sdram.bankno;
-				if (sdram.ap) {
-					bank[n].state = BANK_PRECHARGE;
-					bank[n].busy = tRP - 1; // ? tWR
-				} else {
-					bank[n].state = BANK_ACTIVE;
-				}
-			}
-		} else {
-			printf("sdram: bank%d cannot WRITE from state %s\n", a_bank, SN(a_bank));
+		if (bank[a_bank].state != BANK_ACTIVE) {
+			printf("sdram: %llu: %s bank%u not active (%s)\n",
+				(unsigned long long) now, cname(ctl), a_bank, SN(a_bank));
 			return -1;
 		}
-		if (ctl == CMD_WRITE) {
-			bank[a_bank].state = BANK_WRITE;
-			sdram.state = BANK_WRITE;
-			sdram.count = sdram.wr_burst;
-		} else {
-			bank[a_bank].state = BANK_READ;
-			sdram.state = BANK_READ;
-			sdram.count = sdram.rd_burst;
+		if (check(ctl, a_bank, "tRCD", cfg.T_RCD, "ACTIVE", bank[a_bank].t_active)) {
+			return -1;
+		}
+		// a new READ or WRITE interrupts any burst in progress
+		burst_end();
+		// sample latency for the first READ of an access, from its
+		// PRECHARGE/ACTIVE (row miss) or from the READ itself (row hit)
+		if ((ctl == CMD_READ) && (sdram.last_cmd != CMD_READ)) {
+			sdram.pipe_data_t[(now + sdram.cl) & PIPE_MASK] =
+				bank[a_bank].pending ? bank[a_bank].t_start : now;
 		}
+		note_access(a_bank);
+		sdram.active = 1;
+		sdram.write = (ctl == CMD_WRITE);
 		sdram.bankno = a_bank;
-		sdram.addr = ADDR(a_bank, bank[a_bank].rowaddr, a_col);
-		sdram.count = sdram.wr_burst;
-		sdram.ap = a_a10; // CHECK
+		sdram.col = a_col;
+		sdram.count = (sdram.write && sdram.single_write) ? 1 : sdram.bl;
+		sdram.ap = a_a10;
 		break;
 	case CMD_STOP:
-		if ((sdram.state == BANK_READ) || (sdram.state == BANK_WRITE)) {
-			unsigned n = sdram.bankno;
-			sdram.state = BANK_IDLE;
-			if (sdram.ap) {
-				// TODO: double-check this is corrcet to honor
-				bank[n].state = BANK_PRECHARGE;
-				bank[n].busy = tRP - 1;
-			} else {
-				bank[n].state = BANK_ACTIVE;
-			}
-		}
+		// burst terminate does not auto precharge
+		sdram.active = 0;
 		break;
 	case CMD_NOP:
 		break;
 	}
 
-	// process active read or write operation
-	if (sdram.state != BANK_IDLE) {
-		if (sdram.state == BANK_WRITE) {
-			memory[sdram.addr] = din;
-		} else {
-			sdram.pipe_data_o[0] = memory[sdram.addr];
-			sdram.pipe_data_e[0] = 1;
-		}
-		sdram.count--;
-		if (sdram.count == 0) {
-			sdram.state = BANK_IDLE;
-			if (sdram.ap) {
-				bank[sdram.bankno].state = BANK_PRECHARGE;
-				bank[sdram.bankno].busy = tRP - 1; // ? tWR
-			} else {
-				bank[sdram.bankno].state = BANK_ACTIVE;
+	sdram.last_cmd = ctl;
+
+	// process active read or write burst
+	if (sdram.active) {
+		unsigned n = sdram.bankno;
+		unsigned a = ADDR(n, bank[n].rowaddr, sdram.col);
+		if (sdram.write) {
+			if (rd_driven) {
+				printf("sdram: %llu: WRITE data collides with read data\n",
+					(unsigned long long) now);
+				return -1;
+			}
+			uint16_t* p = mem_ptr(a);
+			if (p == NULL) {
+				printf("sdram: %llu: out of memory\n",
+					(unsigned long long) now);
+				return -1;
 			}
+			*p = din;
+			bank[n].t_write = now;
+			stats.wr_words++;
+			stats.busy++;
 		} else {
-			sdram.addr = (sdram.addr & (~COLMASK)) | ((sdram.addr + 1) & COLMASK);
+			unsigned s = (now + sdram.cl) & PIPE_MASK;
+			sdram.pipe_data_o[s] = mem_rd(a);
+			sdram.pipe_data_e[s] = 1;
+			stats.rd_words++;
+		}
+		// sequential bursts wrap within the burst length
+		unsigned wrap = sdram.bl - 1;
+		sdram.col = (sdram.col & ~wrap) | ((sdram.col + 1) & wrap);
+		if (--sdram.count == 0) {
+			burst_end();
 		}
 	}
 
-done:
+	stats.cycles++;
 	return 0;
 }
 
-
-// TODO: DQM H = read: force dout to highz (2 cycles later)
-//       DQM H = write: mask write
-//
 //       CKE / CS# - currently assumed always H and L
+
+// DPI interface for hdl/sdram/sdram_tlm.sv, which serves the
+// controller's request ports from the same memory, with no
+// pin-level model (addresses are the controller's {row,bank,col})
+extern "C" int dpi_sdram_tlm_read(int addr) {
+	tlm_used = 1;
+	stats.rd_words++;
+	return mem_rd(addr & (ALLWORDS - 1));
+}
+
+extern "C" void dpi_sdram_tlm_write(int addr, int data) {
+	tlm_used = 1;
+	stats.wr_words++;
+	uint16_t* p = mem_ptr(addr & (ALLWORDS - 1));
+	if (p == NULL) {
+		printf("sdram: out of memory\n");
+		exit(1);
+	}
+	*p = data;
+}
+
+extern "C" int dpi_sdram_tlm_latency(void) {
+	unsigned lat = cfg.TLM_LATENCY;
+	tlm_used = 1;
+	if (cfg.TLM_JITTER) {
+		// xorshift32, as hdl/xorshift.sv
+		tlm_rng ^= tlm_rng << 13;
+		tlm_rng ^= tlm_rng >> 17;
+		tlm_rng ^= tlm_rng << 5;
+		lat += tlm_rng % (cfg.TLM_JITTER + 1);
+	}
+	stats.lat_total += lat;
+	stats.lat_count++;
+	if (lat > stats.lat_max) stats.lat_max = lat;
+	return lat;
+}
 #endif
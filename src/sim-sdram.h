@@ -1,5 +1,39 @@
 // Copyright 2020, Brian Swetland <swetland@frotz.net>
 // Licensed under the Apache License, Version 2.0.
 
+#include <stdint.h>
+
+// override geometry and timing with a comma separated list of
+// KEY=VALUE, where KEY is BANKBITS, ROWBITS, COLBITS, T_RCD, T_RC,
+// T_RRD, T_RP, T_WR, T_MRD, T_RI (as in sdram.sv), CL (the minimum
+// CAS latency of the part), or MHZ; call before sim_sdram_init()
+int sim_sdram_config(const char* opts);
+
 void sim_sdram_init(void);
+
+// one clock: ctl is {RAS#,CAS#,WE#}
+// returns nonzero on protocol or timing violations
 int sim_sdram(unsigned ctl, unsigned addr, unsigned din, unsigned* dout);
+
+// 0: errors only (default), 1: commands, 2: every clock
+void sim_sdram_log(int level);
+
+// clock rate used to convert cycle counts to bandwidth
+void sim_sdram_clock(unsigned mhz);
+unsigned sim_sdram_get_clock(void);
+
+// record every command other than NOP to a binary trace file
+// as a sequence of native-endian sim_sdram_trace_t records
+int sim_sdram_trace(const char* fn);
+
+typedef struct {
+	uint32_t cycle;
+	uint8_t cmd;    // RAS/CAS/WE (0 = SET_MODE ... 7 = NOP)
+	uint8_t bank;
+	uint16_t data;  // write data
+	uint32_t addr;  // address pins
+} sim_sdram_trace_t;
+
+// print command counts, row hit/miss/conflict per bank,
+// bus utilization, bandwidth, and read latency; close trace
+void sim_sdram_stats(void);
@@ -35,6 +35,8 @@
 #include "sim-sdram.h"
 #endif
 
+#include "trace16.h"
+
 static unsigned memory[65536];
 
 void dpi_mem_write(int addr, int data) {
@@ -52,8 +54,49 @@ int dpi_mem_read2(int addr) {
 	return (int) memory[addr & 0xFFFF];
 }
 
+// cpu16 retirement trace (hdl/cpu16/testbench.sv), see trace16.h
+static FILE *itrace_fp = NULL;
+static unsigned itrace_count = 0;
+
+static int itrace_open(const char *fn) {
+	if ((itrace_fp = fopen(fn, "wb")) == NULL) {
+		fprintf(stderr, "error: cannot open '%s' for writing\n", fn);
+		return -1;
+	}
+	setvbuf(itrace_fp, NULL, _IOFBF, 1024 * 1024);
+	return 0;
+}
+
+extern "C" void dpi_trace_retire(int cycle, int pc, int ins, int flags, int reg,
+				 int rdata, int maddr, int mdata) {
+	trace16_t rec;
+	if (itrace_fp == NULL) {
+		return;
+	}
+	rec.cycle = cycle;
+	rec.pc = pc;
+	rec.ins = ins;
+	rec.rdata = rdata;
+	rec.maddr = maddr;
+	rec.mdata = mdata;
+	rec.flags = flags;
+	rec.reg = reg;
+	fwrite(&rec, sizeof(rec), 1, itrace_fp);
+	itrace_count++;
+}
+
+// raw little-endian 16bit words (a16 -bin)
+static void loadbin(FILE *fp) {
+	unsigned char buf[2];
+	unsigned a = 0;
+	while ((a < 65536) && (fread(buf, 2, 1, fp) == 1)) {
+		memory[a++] = buf[0] | (buf[1] << 8);
+	}
+}
+
 void loadmem(const char *fn) {
 	unsigned a = 0;
+	size_t len = strlen(fn);
 	FILE *fp = fopen(fn, "r");
 	char buf[128];
 	memset(memory, 0xaa, sizeof(memory));
@@ -61,6 +104,11 @@ void loadmem(const char *fn) {
 		fprintf(stderr, "warning: cannot load memory from '%s'\n", fn);
 		return;
 	}
+	if ((len > 4) && !strcmp(fn + len - 4, ".bin")) {
+		loadbin(fp);
+		fclose(fp);
+		return;
+	}
 	while (fgets(buf, 128, fp) != NULL) {
 		unsigned n;
 		char *x = buf;
@@ -94,6 +142,7 @@ void loadmem(const char *fn) {
 
 static unsigned vga_ticks = 0;
 static unsigned vga_frames = 0;
+static unsigned vga_max_frames = 5;
 static unsigned char vga_data[2][FRAME_BYTES];
 static unsigned vga_active;
 
@@ -124,7 +173,7 @@ static int vga_tick(int hs, int vs, int fr, int red, int grn, int blu) {
 		memset(vga_data[vga_active], 0xff, FRAME_BYTES);
 		vga_ticks = 0;
 		vga_frames++;
-		if (vga_frames == 5) {
+		if (vga_frames == vga_max_frames) {
 			return -1;
 		}
 	}
@@ -149,13 +198,11 @@ static int vga_tick(int hs, int vs, int fr, int red, int grn, int blu) {
 }
 #endif
 
-#ifdef TRACE
 static vluint64_t now = 0;
 
 double sc_time_stamp() {
 	return now;
 }
-#endif
 
 int main(int argc, char **argv) {
 	const char *vcdname = "trace.vcd";
@@ -185,6 +232,16 @@ int main(int argc, char **argv) {
 			memname = argv[2];
 			argv += 2;
 			argc -= 2;
+		} else if (!strcmp(argv[1], "-itrace")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -itrace requires argument\n");
+				return -1;
+			}
+			if (itrace_open(argv[2])) {
+				return -1;
+			}
+			argv += 2;
+			argc -= 2;
 		} else if (!strcmp(argv[1], "-load")) {
 			if (argc < 3) {
 				fprintf(stderr, "error: -load requires argument\n");
@@ -193,6 +250,54 @@ int main(int argc, char **argv) {
 			loadmem(argv[2]);
 			argv += 2;
 			argc -= 2;
+#ifdef VGA
+		} else if (!strcmp(argv[1], "-frames")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -frames requires argument\n");
+				return -1;
+			}
+			vga_max_frames = strtoul(argv[2], 0, 0);
+			argv += 2;
+			argc -= 2;
+#endif
+#ifdef SDRAM
+		} else if (!strcmp(argv[1], "-sdram")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -sdram requires argument\n");
+				return -1;
+			}
+			if (sim_sdram_config(argv[2])) {
+				return -1;
+			}
+			argv += 2;
+			argc -= 2;
+		} else if (!strcmp(argv[1], "-sdram-log")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -sdram-log requires argument\n");
+				return -1;
+			}
+			sim_sdram_log(strtoul(argv[2], 0, 0));
+			argv += 2;
+			argc -= 2;
+		} else if (!strcmp(argv[1], "-sdram-trace")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -sdram-trace requires argument\n");
+				return -1;
+			}
+			if (sim_sdram_trace(argv[2])) {
+				return -1;
+			}
+			argv += 2;
+			argc -= 2;
+		} else if (!strcmp(argv[1], "-sdram-mhz")) {
+			if (argc < 3) {
+				fprintf(stderr, "error: -sdram-mhz requires argument\n");
+				return -1;
+			}
+			sim_sdram_clock(strtoul(argv[2], 0, 0));
+			argv += 2;
+			argc -= 2;
+#endif
 		} else {
 			break;
 		}
@@ -224,7 +329,7 @@ int main(int argc, char **argv) {
 #endif
 
 	int oops = 0;
-	while (!(testbench->done | testbench->error | oops)) { //Verilated::gotFinish()) {
+	while (!(testbench->done | testbench->error | oops | Verilated::gotFinish())) {
 		now += 5;
 		testbench->clk = 0;
 		testbench->eval();
@@ -232,7 +337,7 @@ int main(int argc, char **argv) {
 
 		now += 5;
 		testbench->clk = 1;
-#ifdef SDRAM
+#if defined(SDRAM) && !defined(SDRAM_TLM)
 		unsigned ctl =
 			(testbench->sdram_ras_n << 2) |
 			(testbench->sdram_cas_n << 1) |
@@ -252,12 +357,20 @@ int main(int argc, char **argv) {
 #endif
 	}
 
-	int status = testbench->error ? -1 : 0;
-	fprintf(stderr, "%s: %s\n", argv[0], testbench->error ? "FAIL" : "PASS");
+	int status = (testbench->error || oops) ? -1 : 0;
+	fprintf(stderr, "%s: %s\n", argv[0], status ? "FAIL" : "PASS");
+
+#ifdef SDRAM
+	sim_sdram_stats();
+#endif
 
 #ifdef TRACE
 	tfp->close();
 #endif
+	if (itrace_fp != NULL) {
+		fclose(itrace_fp);
+		fprintf(stderr, "itrace: %u instructions\n", itrace_count);
+	}
 	testbench->final();
 	delete testbench;
 
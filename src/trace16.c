@@ -0,0 +1,202 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+// trace16 - print a cpu16 retirement trace (testbench -itrace)
+//
+// One line per instruction: the cycle it retired in, the d16
+// disassembly (labelled from an a16 listing or l16 map), and its
+// effects, as r3=0012, rd[0080]=0012, or wr[0081]=0040, so the
+// output can be searched with grep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a16.h"
+#include "trace16.h"
+
+// records per read, and the most output per record
+#define CHUNK 4096
+#define TRACE_LINE_MAX (D16_LINE_MAX + 64)
+
+static const char hexdigit[] = "0123456789abcdef";
+
+static char *append_hex4(char *buf, unsigned n) {
+	buf[0] = hexdigit[(n >> 12) & 15];
+	buf[1] = hexdigit[(n >> 8) & 15];
+	buf[2] = hexdigit[(n >> 4) & 15];
+	buf[3] = hexdigit[n & 15];
+	return buf + 4;
+}
+
+// right aligned in 10 columns
+static char *append_cycle(char *buf, unsigned n) {
+	char *x = buf + 10;
+	do {
+		*--x = '0' + (n % 10);
+		n /= 10;
+	} while (n && (x > buf));
+	while (x > buf)
+		*--x = ' ';
+	return buf + 10;
+}
+
+static char *append_mem(char *buf, const char *op, unsigned addr, unsigned data) {
+	*buf++ = ' ';
+	*buf++ = op[0];
+	*buf++ = op[1];
+	*buf++ = '[';
+	buf = append_hex4(buf, addr);
+	*buf++ = ']';
+	*buf++ = '=';
+	return append_hex4(buf, data);
+}
+
+// "0009: f8dc  BNZ R3, 0006 <again>" plus effects, after a "label:"
+// line if the pc is labelled
+static char *format(char *buf, const trace16_t *t, struct d16_symbols *syms) {
+	char tmp[D16_LINE_MAX];
+	size_t len = d16_disassemble_words(tmp, &t->ins, 1, t->pc, syms) - 1;
+	char *x = memchr(tmp, '\n', len);
+
+	if (x) {
+		// label line
+		x++;
+		memcpy(buf, tmp, x - tmp);
+		buf += x - tmp;
+		len -= x - tmp;
+	} else {
+		x = tmp;
+	}
+	buf = append_cycle(buf, t->cycle);
+	*buf++ = ' ';
+	memcpy(buf, x, len);
+	buf += len;
+	if (t->flags & (TRACE16_WREG | TRACE16_RD | TRACE16_WR))
+		*buf++ = ' ';
+	if (t->flags & TRACE16_WREG) {
+		*buf++ = ' ';
+		*buf++ = 'r';
+		*buf++ = '0' + (t->reg & 7);
+		*buf++ = '=';
+		buf = append_hex4(buf, t->rdata);
+	}
+	if (t->flags & TRACE16_RD)
+		buf = append_mem(buf, "rd", t->maddr, t->mdata);
+	if (t->flags & TRACE16_WR)
+		buf = append_mem(buf, "wr", t->maddr, t->mdata);
+	*buf++ = '\n';
+	return buf;
+}
+
+// "lo" or "lo:hi", inclusive
+static int range(const char *s, unsigned *lo, unsigned *hi) {
+	char *end;
+	*lo = strtoul(s, &end, 0);
+	if (*end == ':') {
+		*hi = strtoul(end + 1, &end, 0);
+	} else {
+		*hi = *lo;
+	}
+	return (*end != 0) || (*lo > *hi);
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage:   trace16 [ <option> ]* <trace>\n"
+		"\n"
+		"option:  -sym <file>        labels from an a16 -lst listing or l16 -map\n"
+		"         -o <file>          output file (default stdout)\n"
+		"         -pc <lo>[:<hi>]    only instructions at these addresses\n"
+		"         -reg <n>           only instructions that write Rn\n"
+		"         -mem <lo>[:<hi>]   only loads and stores at these addresses\n"
+		);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	const char *trcname = 0;
+	const char *outname = 0;
+	struct d16_symbols *syms = 0;
+	unsigned pc_lo = 0, pc_hi = 0xFFFF;
+	unsigned mem_lo = 0, mem_hi = 0xFFFF;
+	int mem_only = 0;
+	int reg = -1;
+	static trace16_t trc[CHUNK];
+	static char out[CHUNK * TRACE_LINE_MAX];
+	FILE *fp, *ofp = stdout;
+	size_t count, n;
+	char *buf;
+
+	argc--;
+	argv++;
+	while (argc > 0) {
+		if (argv[0][0] != '-') {
+			if (trcname) usage();
+			trcname = argv[0];
+			argc--;
+			argv++;
+			continue;
+		}
+		if (argc < 2) usage();
+		if (!strcmp(argv[0], "-sym")) {
+			if (!(syms = d16_symbols_load(argv[1]))) {
+				fprintf(stderr, "trace16: cannot load symbols from '%s'\n", argv[1]);
+				return 1;
+			}
+		} else if (!strcmp(argv[0], "-o")) {
+			outname = argv[1];
+		} else if (!strcmp(argv[0], "-pc")) {
+			if (range(argv[1], &pc_lo, &pc_hi)) usage();
+		} else if (!strcmp(argv[0], "-mem")) {
+			if (range(argv[1], &mem_lo, &mem_hi)) usage();
+			mem_only = 1;
+		} else if (!strcmp(argv[0], "-reg")) {
+			const char *r = argv[1];
+			if ((r[0] == 'r') || (r[0] == 'R')) r++;
+			if ((r[0] < '0') || (r[0] > '7') || r[1]) usage();
+			reg = r[0] - '0';
+		} else {
+			usage();
+		}
+		argc -= 2;
+		argv += 2;
+	}
+	if (trcname == 0) usage();
+
+	if (!(fp = fopen(trcname, "rb"))) {
+		fprintf(stderr, "trace16: cannot read '%s'\n", trcname);
+		return 1;
+	}
+	if (outname && !(ofp = fopen(outname, "w"))) {
+		fprintf(stderr, "trace16: cannot write to '%s'\n", outname);
+		return 1;
+	}
+	if (d16_init()) {
+		fprintf(stderr, "trace16: out of memory\n");
+		return 1;
+	}
+	while ((count = fread(trc, sizeof(trc[0]), CHUNK, fp)) > 0) {
+		buf = out;
+		for (n = 0; n < count; n++) {
+			const trace16_t *t = trc + n;
+			if ((t->pc < pc_lo) || (t->pc > pc_hi))
+				continue;
+			if ((reg >= 0) && !((t->flags & TRACE16_WREG) && (t->reg == reg)))
+				continue;
+			if (mem_only && !((t->flags & (TRACE16_RD | TRACE16_WR)) &&
+				(t->maddr >= mem_lo) && (t->maddr <= mem_hi)))
+				continue;
+			buf = format(buf, t, syms);
+		}
+		if (fwrite(out, 1, buf - out, ofp) != (size_t)(buf - out)) {
+			fprintf(stderr, "trace16: write error\n");
+			return 1;
+		}
+	}
+	fclose(fp);
+	if (ofp != stdout)
+		fclose(ofp);
+	d16_symbols_free(syms);
+	return 0;
+}
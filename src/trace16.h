@@ -0,0 +1,24 @@
+// Copyright 2020, Brian Swetland <swetland@frotz.net>
+// Licensed under the Apache License, Version 2.0.
+
+#include <stdint.h>
+
+// cpu16 retirement trace (testbench -itrace, read by trace16)
+//
+// A sequence of native-endian trace16_t records, one per instruction
+// as it leaves write back, in program order.
+
+#define TRACE16_WREG  1  // wrote rdata to register reg
+#define TRACE16_RD    2  // read mdata from maddr
+#define TRACE16_WR    4  // wrote mdata to maddr
+
+typedef struct {
+	uint32_t cycle;  // cycle it retired in
+	uint16_t pc;
+	uint16_t ins;
+	uint16_t rdata;
+	uint16_t maddr;
+	uint16_t mdata;
+	uint8_t flags;   // TRACE16_*
+	uint8_t reg;
+} trace16_t;
@@ -112,11 +112,17 @@ void cmd_wr_u16(int fd, uint32_t addr, uint16_t* p, size_t len) {
 	write(fd, data, msg - data);
 }
 
+// raw little-endian 16bit words (a16 -bin) vs hex text
+static int is_bin(const char *fn) {
+	size_t len = strlen(fn);
+	return (len > 4) && !strcmp(fn + len - 4, ".bin");
+}
+
 int usage(void) {
 	fprintf(stderr,
 		"usage:   udebug <port> <command>*\n"
 		"\n"
-		"command: -load <addr> <hexfile>     - write hex file\n"
+		"command: -load <addr> <hexfile>     - write hex (or .bin) file\n"
 		"         -write <addr> <value>...   - write wolds\n"
 		"         -reset                     - processor RST=1\n"
 		"         -run                       - processor RST=0\n"
@@ -156,7 +162,13 @@ int main(int argc, char **argv) {
 				return -1;
 			}
 			n = 0;
-			while (fgets(buf, 1024, fp)) {
+			if (is_bin(argv[2])) {
+				uint8_t w[2];
+				while (fread(w, 2, 1, fp) == 1) {
+					if (n == 4096) return -1;
+					data[n++] = w[0] | (w[1] << 8);
+				}
+			} else while (fgets(buf, 1024, fp)) {
 				if (!isalnum(buf[0])) continue;
 				if (n == 4096) return -1;
 				data[n++] = strtoul(buf, 0, 16);
@@ -0,0 +1,22 @@
+// LI picks the shortest sequence for each constant
+
+li r0, 0x1FF
+li r1, 0x8000
+li r2, 0x8044
+li r3, 0xF000
+li r4, -100
+li r5, 0x1234
+li r6, 0x7FC0
+li r7, 0x8000
+
+nop
+halt
+
+;R0 01ff
+;R1 8000
+;R2 8044
+;R3 f000
+;R4 ff9c
+;R5 1234
+;R6 7fc0
+;R7 8000
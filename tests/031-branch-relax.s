@@ -0,0 +1,253 @@
+// branches out of short range are relaxed by a16:
+// bnz over 300 words becomes bz over b, bz over 2100
+// words becomes bnz over mov/mhi/b r6
+scratch r6
+mov r1, 0x80
+mov r0, 1
+mov r3, 0
+bnz r0, mid
+sw r0, [r1]
+halt
+
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+
+mid:
+mov r2, 2
+sw r2, [r1]
+bz r3, far
+sw r0, [r1]
+halt
+
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+word 0, 0, 0, 0, 0, 0, 0, 0
+
+far:
+mov r4, 4
+sw r4, [r1]
+nop
+halt
+
+;0080 0002
+;0080 0004
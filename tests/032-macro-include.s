@@ -0,0 +1,15 @@
+// macros from an included file, expanded with arguments,
+// including a label unique to each expansion
+include "032-macros.inc"
+
+mov r5, 1
+mov r1, 3
+times4 r2, r1
+store r2, 0x80
+mov r1, 0x10
+times4 r3, r1
+store r3, 0x81
+halt
+
+;0080 000c
+;0081 0040
@@ -0,0 +1,19 @@
+; -sched must not move code from one section into another,
+; here into one that l16 -gc drops
+;L16 -gc -keep fin
+
+mov r1, 0x80
+mov r2, 0x21
+add r3, r2, r2
+sw r3, [r1]
+
+section unused
+mov r4, 0x44
+mov r5, 0x55
+
+section fin
+global fin
+fin:
+halt
+
+;0080 0042